@@ -0,0 +1,286 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <urdflib.h>
+
+// same vocabulary as examples/unix/main.c
+#define NAMESPACE_cosdataset 7
+#define TERM_coswot_Communication 9
+#define TERM_coswot_hasMedium 10
+#define TERM_coswot_hasCommunicator 11
+#define TERM_coswot_conveys 12
+#define TERM_coswot_isAbout 13
+#define TERM_coswot_hasTimestamp 14
+#define TERM_saref_Observation 15
+#define TERM_saref_madeBy 16
+#define TERM_saref_hasResult 17
+#define TERM_saref_hasValue 18
+#define TERM_saref_resultTime 19
+
+// triples and terms created per observation (see add_observation)
+#define TRIPLES_PER_OBSERVATION 11
+#define TERMS_PER_OBSERVATION 9
+
+// CURIEs of observation k: 3 per observation, local ids are 16-bit
+#define CURIE(k, i) urdflib_create_uriref_curie(NAMESPACE_cosdataset + ((3 * (k) + (i)) >> 16), (3 * (k) + (i)) & 0xFFFF)
+
+/**
+ * Allocator counting calls to the C standard library.
+ */
+typedef struct
+{
+    size_t allocations;
+    size_t reallocations;
+    size_t deallocations;
+    size_t bytes; // bytes currently allocated
+    size_t peak_bytes;
+} counters_t;
+
+counters_t counters;
+
+void count_bytes(size_t old_size, size_t size)
+{
+    counters.bytes += size - old_size;
+    if (counters.bytes > counters.peak_bytes)
+        counters.peak_bytes = counters.bytes;
+}
+
+void *counting_allocate(void *state, size_t size)
+{
+    (void)state;
+    counters.allocations++;
+    count_bytes(0, size);
+    return malloc(size);
+}
+
+void *counting_reallocate(void *state, void *ptr, size_t old_size, size_t size)
+{
+    (void)state;
+    counters.reallocations++;
+    count_bytes(old_size, size);
+    return realloc(ptr, size);
+}
+
+void counting_deallocate(void *state, void *ptr, size_t size)
+{
+    (void)state;
+    counters.deallocations++;
+    counters.bytes -= size;
+    free(ptr);
+}
+
+const urdflib_allocator_t COUNTING_ALLOCATOR = {
+    .allocate = counting_allocate,
+    .reallocate = counting_reallocate,
+    .deallocate = counting_deallocate,
+    .state = NULL};
+
+uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+int cmp_latencies(const void *x, const void *y)
+{
+    uint32_t a = *(const uint32_t *)x;
+    uint32_t b = *(const uint32_t *)y;
+
+    return a < b ? -1 : a > b;
+}
+
+/**
+ * Print throughput and latency percentiles of n calls (latencies are sorted).
+ */
+void print_latencies(FILE *out, const char *name, uint32_t *latencies, size_t n, uint64_t total_ns)
+{
+    qsort(latencies, n, sizeof(uint32_t), cmp_latencies);
+
+    fprintf(out, "      \"%s\": {\"calls\": %zu, \"ns_per_call\": %.1f, \"calls_per_s\": %.0f, "
+                 "\"p50_ns\": %u, \"p99_ns\": %u, \"max_ns\": %u},\n",
+            name, n, n > 0 ? (double)total_ns / n : 0., total_ns > 0 ? 1e9 * n / total_ns : 0.,
+            n > 0 ? latencies[n / 2] : 0, n > 0 ? latencies[n * 99 / 100] : 0, n > 0 ? latencies[n - 1] : 0);
+}
+
+urdflib_t vocab[11];
+
+void init_vocab()
+{
+    static uint8_t storage[11][URDFLIB_TERM_SIZE];
+    uint16_t ids[11] = {TERM_coswot_Communication, TERM_coswot_hasMedium, TERM_coswot_hasCommunicator,
+                        TERM_coswot_conveys, TERM_coswot_isAbout, TERM_coswot_hasTimestamp,
+                        TERM_saref_Observation, TERM_saref_madeBy, TERM_saref_hasResult,
+                        TERM_saref_hasValue, TERM_saref_resultTime};
+
+    for (int i = 0; i < 11; i++)
+        urdflib_init_uriref(&vocab[i], storage[i], URDFLIB_TERM_SIZE, ids[i]);
+}
+
+/**
+ * Add the triples of an observation to g (see examples/unix/main.c),
+ * timing each call to urdflib_add_triple.
+ *
+ * @return the time spent creating terms
+ */
+uint64_t add_observation(urdflib_t *g, size_t k, urdflib_bnode_gen_t *gen, uint32_t *latencies, uint64_t *add_ns)
+{
+    uint64_t start, terms_ns;
+    urdflib_t t[TERMS_PER_OBSERVATION];
+    const urdflib_t *triples[TRIPLES_PER_OBSERVATION][3];
+    urdflib_t *com = &t[0], *obs = &t[1], *sensor = &t[2], *cossb = &t[3], *cosio = &t[4], *res = &t[5];
+    urdflib_t *str = &t[6], *ts = &t[7], *val = &t[8];
+
+    start = now_ns();
+    *com = CURIE(k, 0);
+    *obs = CURIE(k, 1);
+    *sensor = CURIE(k, 2);
+    *cossb = urdflib_create_uriref_curie(NAMESPACE_cosdataset, 0xFFFF);
+    *cosio = urdflib_create_uriref_curie(NAMESPACE_cosdataset, 0xFFFE);
+    *res = urdflib_create_bnode_with(gen);
+    *str = urdflib_create_literal("4ET_429_sensor1_CO2");
+    *ts = urdflib_create_literal_date(1666785720 + k);
+    *val = urdflib_create_literal_float(1250. + k % 100);
+    terms_ns = now_ns() - start;
+
+    triples[0][0] = com, triples[0][1] = &RDF_TYPE, triples[0][2] = &vocab[0];
+    triples[1][0] = com, triples[1][1] = &vocab[1], triples[1][2] = cossb;
+    triples[2][0] = com, triples[2][1] = &vocab[2], triples[2][2] = cosio;
+    triples[3][0] = com, triples[3][1] = &vocab[3], triples[3][2] = obs;
+    triples[4][0] = com, triples[4][1] = &vocab[4], triples[4][2] = str;
+    triples[5][0] = com, triples[5][1] = &vocab[5], triples[5][2] = ts;
+    triples[6][0] = obs, triples[6][1] = &RDF_TYPE, triples[6][2] = &vocab[6];
+    triples[7][0] = obs, triples[7][1] = &vocab[7], triples[7][2] = sensor;
+    triples[8][0] = obs, triples[8][1] = &vocab[8], triples[8][2] = res;
+    triples[9][0] = obs, triples[9][1] = &vocab[10], triples[9][2] = ts;
+    triples[10][0] = res, triples[10][1] = &vocab[9], triples[10][2] = val;
+
+    for (int i = 0; i < TRIPLES_PER_OBSERVATION; i++)
+    {
+        start = now_ns();
+        urdflib_add_triple(g, triples[i][0], triples[i][1], triples[i][2]);
+        latencies[i] = now_ns() - start;
+        *add_ns += latencies[i];
+    }
+
+    for (int i = 0; i < TERMS_PER_OBSERVATION; i++)
+        urdflib_delete(&t[i]);
+
+    return terms_ns;
+}
+
+/**
+ * Run all measurements on a graph of (about) n triples.
+ */
+int bench(FILE *out, size_t n, bool is_last)
+{
+    size_t nb_obs, nb_triples, count;
+    uint64_t start, add_ns, terms_ns, find_ns, freeze_ns;
+    uint32_t *latencies;
+    counters_t add_counters;
+    urdflib_bnode_gen_t gen;
+    urdflib_ctx_t ctx = {0};
+    urdflib_t g, s, p, o;
+    int status;
+
+    nb_obs = (n + TRIPLES_PER_OBSERVATION - 1) / TRIPLES_PER_OBSERVATION;
+    nb_triples = nb_obs * TRIPLES_PER_OBSERVATION;
+
+    latencies = malloc(nb_triples * sizeof(uint32_t));
+    if (latencies == NULL)
+        return 1;
+
+    memset(&counters, 0, sizeof(counters_t));
+    urdflib_bnode_gen_init(&gen, 0);
+    g = urdflib_create_graph();
+
+    add_ns = 0;
+    terms_ns = 0;
+    for (size_t k = 0; k < nb_obs; k++)
+        terms_ns += add_observation(&g, k, &gen, latencies + k * TRIPLES_PER_OBSERVATION, &add_ns);
+
+    add_counters = counters;
+
+    fprintf(out, "    {\n      \"triples\": %zu,\n", nb_triples);
+    fprintf(out, "      \"create_term\": {\"calls\": %zu, \"ns_per_call\": %.1f},\n",
+            nb_obs * TERMS_PER_OBSERVATION, (double)terms_ns / (nb_obs * TERMS_PER_OBSERVATION));
+    print_latencies(out, "add_triple", latencies, nb_triples, add_ns);
+
+    start = now_ns();
+    urdflib_freeze(&g);
+    freeze_ns = now_ns() - start;
+
+    count = 0;
+    find_ns = 0;
+    do
+    {
+        start = now_ns();
+        status = urdflib_find_next_triple(&g, &ctx, &s, &p, &o);
+        latencies[count] = now_ns() - start;
+        find_ns += latencies[count];
+    } while (status == STATUS_OK && ++count < nb_triples);
+
+    print_latencies(out, "find_next_triple", latencies, count, find_ns);
+    fprintf(out, "      \"freeze\": {\"ns\": %llu},\n", (unsigned long long)freeze_ns);
+    fprintf(out, "      \"triples_found\": %zu,\n", count);
+    fprintf(out, "      \"allocations\": %zu,\n      \"reallocations\": %zu,\n      \"peak_bytes\": %zu,\n",
+            add_counters.allocations, add_counters.reallocations, add_counters.peak_bytes);
+    fprintf(out, "      \"bytes_per_triple\": %.2f\n    }%s\n", (double)g.size / nb_triples, is_last ? "" : ",");
+
+    urdflib_delete(&g);
+    free(latencies);
+
+    return count == nb_triples ? 0 : 1;
+}
+
+/**
+ * Usage: urdflib_bench [-o output.json] [number of triples...]
+ * (by default, 10 to 1M triples, written to the standard output).
+ */
+int main(int argc, char const *argv[])
+{
+    size_t default_sizes[] = {10, 100, 1000, 10000, 100000, 1000000};
+    size_t sizes[32];
+    size_t nb_sizes = 0;
+    FILE *out = stdout;
+    int status = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            out = fopen(argv[++i], "w");
+            if (out == NULL)
+            {
+                fprintf(stderr, "File '%s' cannot be opened. Aborting.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (nb_sizes < 32)
+            sizes[nb_sizes++] = strtoul(argv[i], NULL, 10);
+    }
+
+    if (nb_sizes == 0)
+    {
+        nb_sizes = sizeof(default_sizes) / sizeof(size_t);
+        memcpy(sizes, default_sizes, sizeof(default_sizes));
+    }
+
+    urdflib_set_allocator(&COUNTING_ALLOCATOR);
+    init_vocab();
+
+    fprintf(out, "{\n  \"results\": [\n");
+    for (size_t i = 0; i < nb_sizes; i++)
+        status |= bench(out, sizes[i], i + 1 == nb_sizes);
+    fprintf(out, "  ]\n}\n");
+
+    if (out != stdout)
+        fclose(out);
+
+    return status;
+}
@@ -35,6 +35,9 @@ urdflib_t has_result;
 urdflib_t has_value;
 urdflib_t result_time;
 
+// storage for vocabulary terms (no memory allocation)
+uint8_t vocab[11][URDFLIB_TERM_SIZE];
+
 void init_vocab()
 {
     uint8_t b[1] = {0x02};
@@ -42,17 +45,17 @@ void init_vocab()
 
     type = x; // TODO add function to module instead
 
-    communication = urdflib_create_uriref(TERM_coswot_Communication);
-    has_medium = urdflib_create_uriref(TERM_coswot_hasMedium);
-    has_communicator = urdflib_create_uriref(TERM_coswot_hasCommunicator);
-    conveys = urdflib_create_uriref(TERM_coswot_conveys);
-    is_about = urdflib_create_uriref(TERM_coswot_isAbout);
-    has_timestamp = urdflib_create_uriref(TERM_coswot_hasTimestamp);
-    observation = urdflib_create_uriref(TERM_saref_Observation);
-    made_by = urdflib_create_uriref(TERM_saref_madeBy);
-    has_result = urdflib_create_uriref(TERM_saref_hasResult);
-    has_value = urdflib_create_uriref(TERM_saref_hasValue);
-    result_time = urdflib_create_uriref(TERM_saref_resultTime);
+    urdflib_init_uriref(&communication, vocab[0], URDFLIB_TERM_SIZE, TERM_coswot_Communication);
+    urdflib_init_uriref(&has_medium, vocab[1], URDFLIB_TERM_SIZE, TERM_coswot_hasMedium);
+    urdflib_init_uriref(&has_communicator, vocab[2], URDFLIB_TERM_SIZE, TERM_coswot_hasCommunicator);
+    urdflib_init_uriref(&conveys, vocab[3], URDFLIB_TERM_SIZE, TERM_coswot_conveys);
+    urdflib_init_uriref(&is_about, vocab[4], URDFLIB_TERM_SIZE, TERM_coswot_isAbout);
+    urdflib_init_uriref(&has_timestamp, vocab[5], URDFLIB_TERM_SIZE, TERM_coswot_hasTimestamp);
+    urdflib_init_uriref(&observation, vocab[6], URDFLIB_TERM_SIZE, TERM_saref_Observation);
+    urdflib_init_uriref(&made_by, vocab[7], URDFLIB_TERM_SIZE, TERM_saref_madeBy);
+    urdflib_init_uriref(&has_result, vocab[8], URDFLIB_TERM_SIZE, TERM_saref_hasResult);
+    urdflib_init_uriref(&has_value, vocab[9], URDFLIB_TERM_SIZE, TERM_saref_hasValue);
+    urdflib_init_uriref(&result_time, vocab[10], URDFLIB_TERM_SIZE, TERM_saref_resultTime);
 }
 
 int print_count(const urdflib_t *g)
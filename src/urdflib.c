@@ -1,13 +1,42 @@
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include "cbor.h"
 #include "urdflib.h"
 
+#if defined(URDFLIB_STATS) && !defined(ARDUINO)
+#include <time.h>
+#endif
+
+#ifndef URDFLIB_NO_FILES
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifndef URDFLIB_NO_THREADS
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
 /**
  * Initial buffer size for graph buffers.
  */
 #define BUFFER_SIZE 512
 
+/**
+ * Growth factor applied to graph buffers when they are full.
+ */
+#define BUFFER_GROWTH 2
+
+/**
+ * Initial number of slots in subject indexes (must be a power of 2).
+ */
+#define INDEX_SIZE 16
+
 /**
  * JSON-LD keywords
  */
@@ -25,6 +54,7 @@
 #define TAG_NB_URI 327
 #define TAG_NB_VARIABLE 2019
 #define TAG_NB_BNODE 2020
+#define TAG_NB_DIRECTORY 2021
 
 #define TOKEN_ERROR 0
 #define TOKEN_UINT 1
@@ -53,6 +83,13 @@
 #define CBOR_ENCODE_TAG(X, Y, Z) cbor_encode_tag(X, Y, Z)
 #endif
 
+#ifdef URDFLIB_STATS
+static _Thread_local urdflib_stats_t stats;
+#define STATS_ADD(FIELD, N) (stats.FIELD += (N))
+#else
+#define STATS_ADD(FIELD, N)
+#endif
+
 // TODO cannot be const?
 uint8_t RDF_TYPE_BUF[1] = {0x02};
 const urdflib_t RDF_TYPE = {.buffer = RDF_TYPE_BUF, .size = 1, .type = TYPE_URIREF};
@@ -65,6 +102,7 @@ typedef struct
     uint8_t *buffer;
     size_t size;
     uint8_t type;
+    uint64_t value; // argument of the token's head
 } urdflib_token_t;
 
 void urdflib_print_token(urdflib_token_t *token)
@@ -77,21 +115,32 @@ void urdflib_print_token(urdflib_token_t *token)
 
 bool is_curie_tag(const urdflib_token_t *token)
 {
-    const uint8_t b[3] = {0xD9, 0x01, 0x40};
-
-    return token->type == TOKEN_TAG && token->size == 3 && memcmp(token->buffer, b, 3) == 0;
+    return token->type == TOKEN_TAG && token->value == TAG_NB_CURIE;
 }
 
 bool is_bnode_tag(const urdflib_token_t *token)
 {
-    const uint8_t b[3] = {0xD9, 0x07, 0xE4};
-
-    return token->type == TOKEN_TAG && token->size == 3 && memcmp(token->buffer, b, 3) == 0;
+    return token->type == TOKEN_TAG && token->value == TAG_NB_BNODE;
 }
 
 bool is_epoch_tag(const urdflib_token_t *token)
 {
-    return token->type == TOKEN_TAG && token->size == 1 && *(token->buffer) == 0xC1;
+    return token->type == TOKEN_TAG && token->value == TAG_NB_EPOCH;
+}
+
+bool is_variable_tag(const urdflib_token_t *token)
+{
+    return token->type == TOKEN_TAG && token->value == TAG_NB_VARIABLE;
+}
+
+bool is_keyword(const urdflib_token_t *token, uint8_t keyword)
+{
+    return token->type == TOKEN_UINT && token->value == keyword;
+}
+
+bool is_tombstone(const urdflib_token_t *token)
+{
+    return token->type == TOKEN_UNDEF || token->type == TOKEN_BYTE_STRING;
 }
 
 void urdflib_print(const urdflib_t *x)
@@ -132,178 +181,390 @@ bool is_literal(const urdflib_t *x)
     return x->type == TYPE_LITERAL;
 }
 
+bool is_variable(const urdflib_t *x)
+{
+    return x->type == TYPE_VARIABLE;
+}
+
 bool is_id_keyword(const urdflib_t *val)
 {
     return val->type == TYPE_URIREF && val->size == 1 && *(val->buffer) == 0x00;
 }
 
+/**
+ * Bytewise lexicographic order of encoded terms (a prefix coming first),
+ * as for map keys in deterministic CBOR (RFC 8949, section 4.2.1).
+ * Subjects, keys and values of sorted graphs follow this order.
+ */
+int cmp_terms(const urdflib_t *x, const urdflib_t *y)
+{
+    int c = memcmp(x->buffer, y->buffer, x->size < y->size ? x->size : y->size);
+
+    if (c != 0)
+        return c;
+
+    return x->size < y->size ? -1 : x->size > y->size;
+}
+
 int urdflib_cmp(const urdflib_t *x, const urdflib_t *y)
 {
     if (x->type != y->type)
-        return -1;
-    else if (x->size != y->size)
-        return -2;
-    else
-        return memcmp(x->buffer, y->buffer, x->size);
+        return x->type < y->type ? -1 : 1;
+
+    return cmp_terms(x, y);
 }
 
 /*******************************************************************************
- * Functions to decode data from uRDFLib buffers.
+ * Functions to collect statistics (if compiled with URDFLIB_STATS).
  ******************************************************************************/
 
-void set_uint8_token(void *token, uint8_t val)
-{
-    ((urdflib_token_t *)token)->type = TOKEN_UINT;
-}
+#ifdef URDFLIB_STATS
+
+#ifdef ARDUINO
+unsigned long micros(void);
+#endif
 
-void set_uint16_token(void *token, uint16_t val)
+/**
+ * Monotonic time in ns.
+ */
+uint64_t stats_clock()
 {
-    ((urdflib_token_t *)token)->type = TOKEN_UINT;
+#ifdef ARDUINO
+    return (uint64_t)micros() * 1000;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
 }
 
-void set_uint32_token(void *token, uint32_t val)
+/**
+ * Count a call that started at the given time in a latency histogram.
+ */
+void stats_latency(uint64_t *histogram, uint64_t start)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_UINT;
+    uint64_t ns = stats_clock() - start;
+    uint8_t i = 0;
+
+    while (ns > 1 && i < URDFLIB_STATS_BUCKETS - 1)
+    {
+        ns >>= 1;
+        i++;
+    }
+
+    histogram[i]++;
 }
 
-void set_uint64_token(void *token, uint64_t val)
+void urdflib_stats_get(urdflib_stats_t *out)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_UINT;
+    *out = stats;
 }
 
-void set_byte_string_start_token(void *token)
+void urdflib_stats_reset()
 {
-    ((urdflib_token_t *)token)->type = TOKEN_BYTE_STRING_START;
+    memset(&stats, 0, sizeof(urdflib_stats_t));
 }
 
-void set_byte_string_token(void *token, cbor_data buf, uint64_t size)
+#endif
+
+/*******************************************************************************
+ * Functions to allocate memory for uRDFLib buffers.
+ ******************************************************************************/
+
+/**
+ * Alignment of allocations served by arenas.
+ */
+#define ARENA_ALIGN 8
+
+void *libc_allocate(void *state, size_t size)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_BYTE_STRING;
+    (void)state;
+
+    return malloc(size);
 }
 
-void set_string_token(void *token, cbor_data buf, uint64_t size)
+void *libc_reallocate(void *state, void *ptr, size_t old_size, size_t size)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_STRING;
+    (void)state;
+    (void)old_size;
+
+    return realloc(ptr, size);
 }
 
-void set_string_start_token(void *token)
+void libc_deallocate(void *state, void *ptr, size_t size)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_STRING_START;
+    (void)state;
+    (void)size;
+
+    free(ptr);
 }
 
-void set_indef_array_start_token(void *token)
+const urdflib_allocator_t LIBC_ALLOCATOR = {
+    .allocate = libc_allocate,
+    .reallocate = libc_reallocate,
+    .deallocate = libc_deallocate,
+    .state = NULL};
+
+/**
+ * Allocator used by urdflib_create_* functions.
+ */
+static const urdflib_allocator_t *default_allocator = &LIBC_ALLOCATOR;
+
+void urdflib_set_allocator(const urdflib_allocator_t *alloc)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_INDEF_ARRAY_START;
+    default_allocator = alloc != NULL ? alloc : &LIBC_ALLOCATOR;
 }
 
-void set_array_start_token(void *token, uint64_t size)
+/**
+ * Return the allocator of buffer x
+ * (the default allocator if x does not own memory yet).
+ */
+const urdflib_allocator_t *allocator_of(urdflib_t *x)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_ARRAY_START;
+    if (x->alloc == NULL)
+        x->alloc = default_allocator;
+
+    return x->alloc;
 }
 
-void set_indef_map_start_token(void *token)
+void *mem_alloc(const urdflib_allocator_t *alloc, size_t size)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_INDEF_MAP_START;
+    STATS_ADD(allocations, 1);
+    return alloc->allocate(alloc->state, size);
 }
 
-void set_map_start_token(void *token, uint64_t size)
+void *mem_calloc(const urdflib_allocator_t *alloc, size_t nb, size_t size)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_MAP_START;
+    void *ptr;
+
+    STATS_ADD(allocations, 1);
+    ptr = alloc->allocate(alloc->state, nb * size);
+    if (ptr != NULL)
+        memset(ptr, 0, nb * size);
+
+    return ptr;
 }
 
-void set_tag_token(void *token, uint64_t tag)
+void mem_free(const urdflib_allocator_t *alloc, void *ptr, size_t size)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_TAG;
+    if (ptr != NULL)
+    {
+        STATS_ADD(deallocations, 1);
+        alloc->deallocate(alloc->state, ptr, size);
+    }
 }
 
-void set_float_token(void *token, float val)
+void *arena_allocate(void *state, size_t size)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_FLOAT;
+    urdflib_arena_t *arena = state;
+    size_t start;
+
+    start = (arena->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (start > arena->size || size > arena->size - start)
+        return NULL;
+
+    arena->last = start;
+    arena->used = start + size;
+
+    return arena->buffer + start;
 }
 
-void set_double_token(void *token, double val)
+void *arena_reallocate(void *state, void *ptr, size_t old_size, size_t size)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_FLOAT;
+    urdflib_arena_t *arena = state;
+    uint8_t *new_ptr;
+
+    if (ptr == NULL)
+        return arena_allocate(state, size);
+
+    // last allocation: grow (or shrink) in place
+    if (ptr == arena->buffer + arena->last)
+    {
+        if (size > arena->size - arena->last)
+            return NULL;
+
+        arena->used = arena->last + size;
+        return ptr;
+    }
+
+    if (size <= old_size)
+        return ptr;
+
+    new_ptr = arena_allocate(state, size);
+    if (new_ptr != NULL)
+        memcpy(new_ptr, ptr, old_size);
+
+    return new_ptr;
 }
 
-void set_undefined_token(void *token)
+void arena_deallocate(void *state, void *ptr, size_t size)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_UNDEF;
+    urdflib_arena_t *arena = state;
+
+    // only the last allocation can be given back
+    if (ptr == arena->buffer + arena->last && arena->used == arena->last + size)
+        arena->used = arena->last;
 }
 
-void set_null_token(void *token)
+const urdflib_allocator_t *urdflib_arena_init(urdflib_arena_t *arena, uint8_t *buffer, size_t size)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_NULL;
+    arena->buffer = buffer;
+    arena->size = size;
+    arena->used = 0;
+    arena->last = 0;
+
+    arena->allocator.allocate = arena_allocate;
+    arena->allocator.reallocate = arena_reallocate;
+    arena->allocator.deallocate = arena_deallocate;
+    arena->allocator.state = arena;
+
+    return &arena->allocator;
 }
 
-void set_boolean_token(void *token, bool val)
+void urdflib_arena_reset(urdflib_arena_t *arena)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_BOOLEAN;
+    arena->used = 0;
+    arena->last = 0;
 }
 
-void set_indef_break_token(void *token)
+/*******************************************************************************
+ * Functions to decode data from uRDFLib buffers.
+ ******************************************************************************/
+
+/**
+ * Marker for reserved additional information values (28-30).
+ */
+#define ARG_INVALID 0xFF
+
+/**
+ * Size of the argument following the initial byte of a CBOR token,
+ * indexed by additional information (5 low-order bits of the initial byte).
+ */
+static const uint8_t ARG_SIZES[32] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8,
+    ARG_INVALID, ARG_INVALID, ARG_INVALID, 0};
+
+/**
+ * Token types of definite-length items, indexed by major type
+ * (major type 7 is looked up in SIMPLE_TOKEN_TYPES instead).
+ */
+static const uint8_t MAJOR_TOKEN_TYPES[8] = {
+    TOKEN_UINT, TOKEN_NEGINT, TOKEN_BYTE_STRING, TOKEN_STRING,
+    TOKEN_ARRAY_START, TOKEN_MAP_START, TOKEN_TAG, TOKEN_ERROR};
+
+/**
+ * Token types of indefinite-length items (additional information 31),
+ * indexed by major type.
+ */
+static const uint8_t INDEF_TOKEN_TYPES[8] = {
+    TOKEN_ERROR, TOKEN_ERROR, TOKEN_BYTE_STRING_START, TOKEN_STRING_START,
+    TOKEN_INDEF_ARRAY_START, TOKEN_INDEF_MAP_START, TOKEN_ERROR, TOKEN_INDEF_BREAK};
+
+/**
+ * Token types of simple values and floats (major type 7),
+ * indexed by additional information.
+ */
+static const uint8_t SIMPLE_TOKEN_TYPES[32] = {
+    TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR,
+    TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR,
+    TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR, TOKEN_BOOLEAN, TOKEN_BOOLEAN, TOKEN_NULL, TOKEN_UNDEF,
+    TOKEN_ERROR, TOKEN_FLOAT, TOKEN_FLOAT, TOKEN_FLOAT, TOKEN_ERROR, TOKEN_ERROR, TOKEN_ERROR, TOKEN_INDEF_BREAK};
+
+/**
+ * Argument of the CBOR head starting at b, whose size is given by ARG_SIZES.
+ */
+uint64_t head_value(const uint8_t *b)
 {
-    ((urdflib_token_t *)token)->type = TOKEN_INDEF_BREAK;
+    uint8_t info = b[0] & 0x1F;
+    uint64_t value = info < 24 ? info : 0;
+
+    for (uint8_t i = 1; i <= ARG_SIZES[info]; i++)
+        value = (value << 8) | b[i];
+
+    return value;
 }
 
 /**
  * Decode the next CBOR token in the input buffer.
  * No memory allocation is done.
+ *
+ * Only the subset of CBOR used by uRDFLib is supported:
+ * string chunks of indefinite-length strings are not inspected.
+ * The token's argument (integer value, tag number, length, etc.)
+ * is decoded as well.
  */
 int decode_token(const urdflib_t *x, size_t *idx, urdflib_token_t *token)
 {
-    const struct cbor_callbacks cb = {
-        .uint8 = set_uint8_token,
-        .uint16 = set_uint16_token,
-        .uint32 = set_uint32_token,
-        .uint64 = set_uint64_token,
-        // TODO callback for negative integers?
-        .negint8 = cbor_empty_callbacks.negint8,
-        .negint16 = cbor_empty_callbacks.negint16,
-        .negint32 = cbor_empty_callbacks.negint32,
-        .negint64 = cbor_empty_callbacks.negint64,
-        .byte_string_start = set_byte_string_start_token,
-        .byte_string = set_byte_string_token,
-        .string = set_string_token,
-        .string_start = set_string_start_token,
-        .indef_array_start = set_indef_array_start_token,
-        .array_start = set_array_start_token,
-        .indef_map_start = set_indef_map_start_token,
-        .map_start = set_map_start_token,
-        .tag = set_tag_token,
-        .float2 = set_float_token,
-        .float4 = set_float_token,
-        .float8 = set_double_token,
-        .undefined = set_undefined_token,
-        .null = set_null_token,
-        .boolean = set_boolean_token,
-        .indef_break = set_indef_break_token};
-
-    struct cbor_decoder_result res;
-
-    res = cbor_stream_decode(x->buffer + *idx, x->size - *idx, &cb, token);
-
-    if (res.status != CBOR_DECODER_FINISHED)
+    const uint8_t *b;
+    uint8_t major, info, arg_size;
+    uint64_t value;
+
+    token->type = TOKEN_ERROR;
+
+    if (*idx >= x->size)
+        return STATUS_CBOR_ERROR;
+
+    b = x->buffer + *idx;
+    major = b[0] >> 5;
+    info = b[0] & 0x1F;
+
+    arg_size = ARG_SIZES[info];
+    if (arg_size == ARG_INVALID || x->size - *idx <= arg_size)
+        return STATUS_CBOR_ERROR;
+
+    value = head_value(b);
+
+    token->buffer = (uint8_t *)b;
+    token->size = 1 + arg_size;
+    token->value = value;
+
+    if (info == 31)
+        token->type = INDEF_TOKEN_TYPES[major];
+    else if (major == 7)
+        token->type = SIMPLE_TOKEN_TYPES[info];
+    else
+        token->type = MAJOR_TOKEN_TYPES[major];
+
+    if (token->type == TOKEN_STRING || token->type == TOKEN_BYTE_STRING)
+    {
+        if (value > x->size - *idx - token->size)
+        {
+            token->type = TOKEN_ERROR;
+            return STATUS_CBOR_ERROR;
+        }
+
+        token->size += value;
+    }
+
+    if (token->type == TOKEN_ERROR)
         return STATUS_CBOR_ERROR;
 
-    token->buffer = x->buffer + *idx;
-    token->size = res.read;
-    // token's type set by callback
+    STATS_ADD(tokens_decoded, 1);
+    STATS_ADD(bytes_decoded, token->size);
 
     *idx += token->size;
 
     return STATUS_OK;
 }
 
-int lookup_token(const urdflib_t *x, size_t *idx, urdflib_token_t *token)
+/**
+ * Check whether the next token is a break, without decoding it.
+ */
+bool lookup_break(const urdflib_t *x, size_t idx)
 {
-    int status;
-    size_t lookup_idx;
-
-    lookup_idx = *idx;
-    status = decode_token(x, &lookup_idx, token);
+    return idx < x->size && x->buffer[idx] == 0xFF;
+}
 
-    return status;
+/**
+ * Check whether the next token is the tombstone of a removed term
+ * (undefined or a byte string, see encode_tombstone), without decoding it.
+ */
+bool lookup_tombstone(const urdflib_t *x, size_t idx)
+{
+    return idx < x->size && (x->buffer[idx] == 0xF7 || (x->buffer[idx] >= 0x40 && x->buffer[idx] <= 0x5B));
 }
 
 int decode_value(const urdflib_t *g, size_t *idx, urdflib_t *val)
@@ -313,8 +574,12 @@ int decode_value(const urdflib_t *g, size_t *idx, urdflib_t *val)
     size_t start_idx;
     urdflib_token_t token;
 
-    status = lookup_token(g, idx, &token);
-    if (token.type == TOKEN_INDEF_BREAK)
+    // removed terms are skipped
+    while (lookup_tombstone(g, *idx))
+        if (decode_token(g, idx, &token) < STATUS_OK)
+            return STATUS_BUFFER_ERROR;
+
+    if (lookup_break(g, *idx))
         return STATUS_NO_ITEM;
 
     start_idx = *idx;
@@ -358,8 +623,16 @@ int decode_value(const urdflib_t *g, size_t *idx, urdflib_t *val)
 
             type = TYPE_LITERAL;
         }
+        else if (is_variable_tag(&token))
+        {
+            decode_token(g, idx, &token);
+            if (token.type != TOKEN_UINT)
+                return STATUS_BUFFER_ERROR;
 
-        // TODO variable
+            type = TYPE_VARIABLE;
+        }
+        else
+            return STATUS_BUFFER_ERROR;
     }
     else
         return STATUS_BUFFER_ERROR;
@@ -392,7 +665,7 @@ int decode_graph_start(const urdflib_t *g, size_t *idx, urdflib_t *id)
     status = decode_token(g, idx, &token);
 
     // TODO make @id, @type tokens static
-    if (token.type == TOKEN_UINT && *(token.buffer) == 0x00)
+    if (is_keyword(&token, KEYWORD_ID))
     {
         // { @id: ..., ... }
         status = decode_value(g, idx, id);
@@ -407,7 +680,7 @@ int decode_graph_start(const urdflib_t *g, size_t *idx, urdflib_t *id)
     }
 
     // { ..., @graph: [...] }
-    if (token.type != TOKEN_UINT || *(token.buffer) != 0x01)
+    if (!is_keyword(&token, KEYWORD_GRAPH))
         return STATUS_BUFFER_ERROR;
 
     status = decode_token(g, idx, &token);
@@ -422,8 +695,7 @@ int decode_node_start(const urdflib_t *g, size_t *idx, urdflib_t *id)
     int status;
     urdflib_token_t token;
 
-    status = lookup_token(g, idx, &token);
-    if (token.type == TOKEN_INDEF_BREAK)
+    if (lookup_break(g, *idx))
         return STATUS_NO_ITEM;
 
     // { }
@@ -434,7 +706,7 @@ int decode_node_start(const urdflib_t *g, size_t *idx, urdflib_t *id)
     // { @id: ..., ... }
     // TODO if blank node, skip
     status = decode_token(g, idx, &token);
-    if (token.type != TOKEN_UINT || *(token.buffer) != 0x00)
+    if (!is_keyword(&token, KEYWORD_ID))
         return STATUS_BUFFER_ERROR;
 
     status = decode_value(g, idx, id);
@@ -447,41 +719,61 @@ int decode_key(const urdflib_t *g, size_t *idx, urdflib_t *key)
     int status;
     urdflib_token_t token;
 
-    status = lookup_token(g, idx, &token);
-    if (token.type == TOKEN_INDEF_BREAK)
+    if (lookup_break(g, *idx))
         return STATUS_NO_ITEM;
 
     status = decode_value(g, idx, key);
+    if (status < STATUS_OK)
+        return status;
+
     // FIXME if key is null, segfault
-    if (key->type != TYPE_URIREF)
+    if (key->type != TYPE_URIREF && key->type != TYPE_VARIABLE)
         return STATUS_BUFFER_ERROR;
 
     return status;
 }
 
-int decode_values_start(const urdflib_t *g, size_t *idx)
+/**
+ * Decode the start of the value(s) of a key:
+ * several values are given as an indefinite-length array.
+ */
+int decode_values_start(const urdflib_t *g, size_t *idx, bool *has_single_value)
 {
-    // TODO
+    // { ..., key: [ ... ] }
+    *has_single_value = *idx >= g->size || g->buffer[*idx] != 0x9F;
+
+    if (!*has_single_value)
+        *idx += 1;
+
     return STATUS_OK;
 }
 
 int decode_values_end(const urdflib_t *g, size_t *idx)
 {
-    // TODO
-    return STATUS_OK;
+    int status;
+    urdflib_token_t token;
+
+    status = decode_token(g, idx, &token);
+    if (token.type != TOKEN_INDEF_BREAK)
+        return STATUS_BUFFER_ERROR;
+
+    return status;
 }
 
-int decode_pair(const urdflib_t *g, size_t *idx, urdflib_t *key)
+/**
+ * Decode (and skip) the value(s) of a key.
+ */
+int decode_values(const urdflib_t *g, size_t *idx)
 {
     int status;
+    bool has_single_value;
 
-    status = decode_key(g, idx, key);
+    status = decode_values_start(g, idx, &has_single_value);
     if (status < STATUS_OK)
         return status;
 
-    status = decode_values_start(g, idx);
-    if (status < STATUS_OK)
-        return status;
+    if (has_single_value)
+        return decode_value(g, idx, NULL);
 
     do
         status = decode_value(g, idx, NULL);
@@ -493,6 +785,17 @@ int decode_pair(const urdflib_t *g, size_t *idx, urdflib_t *key)
     return status;
 }
 
+int decode_pair(const urdflib_t *g, size_t *idx, urdflib_t *key)
+{
+    int status;
+
+    status = decode_key(g, idx, key);
+    if (status < STATUS_OK)
+        return status;
+
+    return decode_values(g, idx);
+}
+
 int decode_pairs(const urdflib_t *g, size_t *idx)
 {
     urdflib_t key; // not inspected
@@ -500,7 +803,7 @@ int decode_pairs(const urdflib_t *g, size_t *idx)
 
     do
         status = decode_pair(g, idx, &key);
-    while (status > 0);
+    while (status == STATUS_OK);
 
     return status < STATUS_NO_ITEM ? status : STATUS_OK;
 }
@@ -535,18 +838,108 @@ int decode_graph_end(const urdflib_t *g, size_t *idx)
     return status;
 }
 
+/**
+ * Decode (and skip) the rest of a node after its @id:
+ * its pairs or, for a named graph in a dataset, its nodes.
+ */
+int decode_node_body(const urdflib_t *g, size_t *idx)
+{
+    int status;
+    urdflib_t id;
+
+    if (is_dataset(g) && *idx + 1 < g->size && g->buffer[*idx] == KEYWORD_GRAPH && g->buffer[*idx + 1] == 0x9F)
+    {
+        // { @id: name, @graph: [ ... ] }
+        *idx += 2;
+
+        while ((status = decode_node_start(g, idx, &id)) == STATUS_OK)
+        {
+            status = decode_pairs(g, idx);
+            if (status == STATUS_OK)
+                status = decode_node_end(g, idx);
+            if (status < STATUS_OK)
+                return status;
+        }
+
+        if (status != STATUS_NO_ITEM)
+            return status;
+
+        return decode_graph_end(g, idx);
+    }
+
+    status = decode_pairs(g, idx);
+    if (status < STATUS_OK)
+        return status;
+
+    return decode_node_end(g, idx);
+}
+
 /*******************************************************************************
  * Functions to encode data to uRDFLib buffers.
  ******************************************************************************/
 
-int encode_uriref(urdflib_t *g, size_t *idx, uint16_t id)
+/**
+ * Ensure buffer x can hold at least size bytes.
+ * Capacity grows geometrically to bound the number of reallocations.
+ */
+static int reserve(urdflib_t *x, size_t size)
+{
+    size_t capacity;
+    uint8_t *buffer;
+    const urdflib_allocator_t *alloc;
+
+    if (size <= x->capacity)
+        return STATUS_OK;
+
+    // buffer not owned by uRDFLib
+    if (x->capacity == 0 && x->buffer != NULL)
+        return STATUS_BUFFER_ERROR;
+
+    capacity = x->capacity > 0 ? x->capacity : BUFFER_SIZE;
+    while (capacity < size)
+        capacity *= BUFFER_GROWTH;
+
+    alloc = allocator_of(x);
+    STATS_ADD(reallocations, 1);
+    buffer = alloc->reallocate(alloc->state, x->buffer, x->capacity, capacity);
+    if (buffer == NULL)
+        return STATUS_MALLOC_ERROR;
+
+    x->buffer = buffer;
+    x->capacity = capacity;
+
+    return STATUS_OK;
+}
+
+/**
+ * Open a gap of len bytes at position idx in buffer x
+ * by shifting all subsequent bytes (once).
+ */
+static int insert_gap(urdflib_t *x, size_t idx, size_t len)
+{
+    int status;
+
+    status = reserve(x, x->size + len);
+    if (status < STATUS_OK)
+        return status;
+
+    STATS_ADD(bytes_encoded, len);
+    STATS_ADD(bytes_moved, x->size - idx);
+
+    memmove(x->buffer + idx + len, x->buffer + idx, x->size - idx);
+    x->size += len;
+
+    return STATUS_OK;
+}
+
+int encode_uriref(urdflib_t *g, size_t *idx, urdflib_id_t id)
 {
-    *idx += CBOR_ENCODE_UINT(id, g->buffer + *idx, g->size);
+    *idx += CBOR_ENCODE_UINT(id, g->buffer + *idx, g->size - *idx);
 
     return STATUS_OK;
 }
 
-int encode_uriref_curie(urdflib_t *g, size_t *idx, uint16_t ns_id, uint16_t local_id)
+int encode_uriref_curie(urdflib_t *g, size_t *idx, urdflib_id_t ns_id, urdflib_id_t local_id)
 {
     *idx += CBOR_ENCODE_TAG(TAG_NB_CURIE, g->buffer + *idx, g->size - *idx);
     *idx += cbor_encode_array_start(2, g->buffer + *idx, g->size - *idx);
@@ -556,7 +949,7 @@ int encode_uriref_curie(urdflib_t *g, size_t *idx, uint16_t ns_id, uint16_t loca
     return STATUS_OK;
 }
 
-int encode_bnode(urdflib_t *g, size_t *idx, uint16_t id)
+int encode_bnode(urdflib_t *g, size_t *idx, uint64_t id)
 {
     *idx += CBOR_ENCODE_TAG(TAG_NB_BNODE, g->buffer + *idx, g->size - *idx);
     *idx += CBOR_ENCODE_UINT(id, g->buffer + *idx, g->size - *idx);
@@ -594,7 +987,7 @@ int encode_literal_date(urdflib_t *g, size_t *idx, uint64_t unix_ts)
 
 int encode_value(urdflib_t *g, size_t *idx, const urdflib_t *val)
 {
-    if (!is_uriref(val) && !is_bnode(val) && !is_literal(val))
+    if (!is_uriref(val) && !is_bnode(val) && !is_literal(val) && !is_variable(val))
         return -1;
 
     memcpy(g->buffer + *idx, val->buffer, val->size);
@@ -619,24 +1012,24 @@ int encode_typed_literal(urdflib_t *g, size_t *idx, const char *lex, const urdfl
     return STATUS_OK;
 }
 
-int encode_variable(urdflib_t *g, size_t *idx, uint16_t var_idx)
+int encode_variable(urdflib_t *g, size_t *idx, urdflib_id_t var_idx)
 {
     *idx += CBOR_ENCODE_TAG(TAG_NB_VARIABLE, g->buffer + *idx, g->size - *idx);
-    *idx += CBOR_ENCODE_UINT(var_idx, g->buffer + *idx, g->size);
+    *idx += CBOR_ENCODE_UINT(var_idx, g->buffer + *idx, g->size - *idx);
 
     return STATUS_OK;
 }
 
 int encode_id(urdflib_t *g, size_t *idx, const urdflib_t *id)
 {
-    if (!is_uriref(id) && !is_bnode(id))
+    if (!is_uriref(id) && !is_bnode(id) && !is_variable(id))
         return -1;
     return encode_value(g, idx, id);
 }
 
 int encode_key(urdflib_t *g, size_t *idx, const urdflib_t *key)
 {
-    if (!is_uriref(key))
+    if (!is_uriref(key) && !is_variable(key))
         return -1;
     return encode_value(g, idx, key);
 }
@@ -644,7 +1037,7 @@ int encode_key(urdflib_t *g, size_t *idx, const urdflib_t *key)
 int encode_graph_start(urdflib_t *g, size_t *idx, const urdflib_t *id)
 {
     // {...}
-    *idx += cbor_encode_indef_map_start(g->buffer + *idx, g->size);
+    *idx += cbor_encode_indef_map_start(g->buffer + *idx, g->size - *idx);
 
     if (id != NULL)
     {
@@ -666,7 +1059,7 @@ int encode_graph_start(urdflib_t *g, size_t *idx, const urdflib_t *id)
 int encode_node_start(urdflib_t *g, size_t *idx, const urdflib_t *id)
 {
     // encode map start
-    *idx += cbor_encode_indef_map_start(g->buffer + *idx, g->size);
+    *idx += cbor_encode_indef_map_start(g->buffer + *idx, g->size - *idx);
 
     if (id != NULL)
     {
@@ -677,6 +1070,20 @@ int encode_node_start(urdflib_t *g, size_t *idx, const urdflib_t *id)
     return STATUS_OK;
 }
 
+int encode_values_start(urdflib_t *g, size_t *idx)
+{
+    *idx += cbor_encode_indef_array_start(g->buffer + *idx, g->size - *idx);
+
+    return STATUS_OK;
+}
+
+int encode_values_end(urdflib_t *g, size_t *idx)
+{
+    *idx += cbor_encode_break(g->buffer + *idx, g->size - *idx);
+
+    return STATUS_OK;
+}
+
 int encode_node_end(urdflib_t *g, size_t *idx)
 {
     *idx += cbor_encode_break(g->buffer + *idx, g->size - *idx);
@@ -693,413 +1100,5382 @@ int encode_graph_end(urdflib_t *g, size_t *idx)
 }
 
 /*******************************************************************************
- * Main functions of the uRDFLib module.
+ * Functions to index subjects of graph buffers.
  ******************************************************************************/
 
-urdflib_t urdflib_create_uriref(uint16_t id)
+/**
+ * Slot of a subject index (offset 0 denotes an empty slot,
+ * as no node can start at the beginning of a graph buffer).
+ */
+typedef struct
 {
-    uint8_t buf[4];
-    size_t idx;
-    urdflib_t uriref;
+    size_t offset;
+    uint32_t hash;
+} urdflib_index_slot_t;
 
-    uriref.buffer = buf;
-    uriref.size = 4;
-    uriref.type = TYPE_URIREF;
+/**
+ * Open addressing hash table, keyed by encoded subjects.
+ */
+struct urdflib_index
+{
+    urdflib_index_slot_t *slots;
+    size_t capacity;
+    size_t count;
+    const urdflib_allocator_t *alloc;
+};
 
-    idx = 0;
-    encode_uriref(&uriref, &idx, id);
+/**
+ * FNV-1a hash of size bytes.
+ */
+uint32_t hash_bytes(const uint8_t *b, size_t size)
+{
+    uint32_t h = 2166136261u;
 
-    // to avoid successive malloc/realloc, temp buffer is used to encode val
-    // TODO predict size beforehand
-    uriref.buffer = malloc(idx);
-    memcpy(uriref.buffer, buf, idx);
-    uriref.size = idx;
+    for (size_t i = 0; i < size; i++)
+        h = (h ^ b[i]) * 16777619u;
 
-    return uriref;
+    return h;
 }
 
-urdflib_t urdflib_create_uriref_curie(uint16_t ns_id, uint16_t local_id)
-{
-    uint8_t buf[20];
+/**
+ * Mix hash h with d (MurmurHash3 finalizer), e.g. to place a key with hash h
+ * in a bucket of displacement d of a perfect hash table.
+ */
+uint32_t hash_displace(uint32_t h, uint32_t d)
+{
+    h ^= d * 0x9E3779B9u;
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/**
+ * FNV-1a hash of the encoded representation of x.
+ */
+uint32_t hash_buffer(const urdflib_t *x)
+{
+    return hash_bytes(x->buffer, x->size);
+}
+
+/**
+ * Check that the node found at offset has subject s.
+ * Since CBOR items are self-delimiting, comparing bytes after @id is enough.
+ */
+bool has_subject(const urdflib_t *g, size_t offset, const urdflib_t *s)
+{
+    // { @id: s, ... }
+    return offset + 2 + s->size <= g->size && memcmp(g->buffer + offset + 2, s->buffer, s->size) == 0;
+}
+
+void index_put(struct urdflib_index *index, uint32_t hash, size_t offset)
+{
+    size_t i;
+
+    i = hash & (index->capacity - 1);
+    while (index->slots[i].offset > 0)
+        i = (i + 1) & (index->capacity - 1);
+
+    index->slots[i].offset = offset;
+    index->slots[i].hash = hash;
+    index->count++;
+}
+
+/**
+ * Add the node at offset to the index, doubling its size if half full.
+ */
+int index_insert(struct urdflib_index *index, uint32_t hash, size_t offset)
+{
+    urdflib_index_slot_t *slots;
+    size_t capacity;
+
+    if (2 * (index->count + 1) > index->capacity)
+    {
+        slots = index->slots;
+        capacity = index->capacity;
+
+        index->slots = mem_calloc(index->alloc, 2 * capacity, sizeof(urdflib_index_slot_t));
+        if (index->slots == NULL)
+        {
+            index->slots = slots;
+            return STATUS_MALLOC_ERROR;
+        }
+
+        index->capacity = 2 * capacity;
+        index->count = 0;
+
+        for (size_t i = 0; i < capacity; i++)
+            if (slots[i].offset > 0)
+                index_put(index, slots[i].hash, slots[i].offset);
+
+        mem_free(index->alloc, slots, capacity * sizeof(urdflib_index_slot_t));
+    }
+
+    index_put(index, hash, offset);
+
+    return STATUS_OK;
+}
+
+/**
+ * Return the offset of the node of subject s, or 0 if not indexed.
+ */
+size_t index_find(const struct urdflib_index *index, const urdflib_t *g, const urdflib_t *s)
+{
+    uint32_t hash;
+    size_t i;
+
+    hash = hash_buffer(s);
+
+    i = hash & (index->capacity - 1);
+    while (index->slots[i].offset > 0)
+    {
+        if (index->slots[i].hash == hash && has_subject(g, index->slots[i].offset, s))
+            return index->slots[i].offset;
+
+        i = (i + 1) & (index->capacity - 1);
+    }
+
+    return 0;
+}
+
+/**
+ * Update offsets of all nodes located after idx once len bytes were inserted at idx.
+ */
+void index_shift(struct urdflib_index *index, size_t idx, size_t len)
+{
+    for (size_t i = 0; i < index->capacity; i++)
+        if (index->slots[i].offset > idx)
+            index->slots[i].offset += len;
+}
+
+void index_free(struct urdflib_index *index)
+{
+    if (index == NULL)
+        return;
+
+    mem_free(index->alloc, index->slots, index->capacity * sizeof(urdflib_index_slot_t));
+    mem_free(index->alloc, index, sizeof(struct urdflib_index));
+}
+
+void index_delete(urdflib_t *g)
+{
+    index_free(g->index);
+    g->index = NULL;
+}
+
+/**
+ * Create an empty index.
+ *
+ * @return the index or NULL on error
+ */
+struct urdflib_index *index_new(const urdflib_allocator_t *alloc)
+{
+    struct urdflib_index *index;
+
+    index = mem_alloc(alloc, sizeof(struct urdflib_index));
+    if (index == NULL)
+        return NULL;
+
+    index->slots = mem_calloc(alloc, INDEX_SIZE, sizeof(urdflib_index_slot_t));
+    index->capacity = INDEX_SIZE;
+    index->count = 0;
+    index->alloc = alloc;
+
+    if (index->slots == NULL)
+    {
+        mem_free(alloc, index, sizeof(struct urdflib_index));
+        return NULL;
+    }
+
+    return index;
+}
+
+/**
+ * Create the subject index of graph g (or the graph name index of a dataset)
+ * in a single scan.
+ *
+ * @return the index or NULL on error
+ */
+struct urdflib_index *index_create(const urdflib_t *g, const urdflib_allocator_t *alloc)
+{
+    int status;
+    size_t idx, node_idx;
+    urdflib_t id;
+    struct urdflib_index *index;
+
+    index = index_new(alloc);
+    if (index == NULL)
+        return NULL;
+
+    idx = 0;
+    status = decode_graph_start(g, &idx, NULL);
+
+    while (status == STATUS_OK)
+    {
+        node_idx = idx;
+        status = decode_node_start(g, &idx, &id);
+
+        if (status == STATUS_OK)
+            status = index_insert(index, hash_buffer(&id), node_idx);
+        if (status == STATUS_OK)
+            status = decode_node_body(g, &idx);
+    }
+
+    if (status != STATUS_NO_ITEM)
+    {
+        index_free(index);
+        return NULL;
+    }
+
+    return index;
+}
+
+/**
+ * Find the node of subject s in graph g by scanning it.
+ *
+ * @return the offset of the node, 0 if not found or an error code
+ */
+ptrdiff_t scan_subject(const urdflib_t *g, const urdflib_t *s)
+{
+    int status;
+    size_t idx, node_idx;
+    urdflib_t id;
+
+    idx = 0;
+    status = decode_graph_start(g, &idx, NULL);
+
+    while (status == STATUS_OK)
+    {
+        node_idx = idx;
+        status = decode_node_start(g, &idx, &id);
+
+        if (status == STATUS_OK && urdflib_cmp(s, &id) == 0)
+            return node_idx;
+
+        STATS_ADD(nodes_skipped, 1);
+
+        if (status == STATUS_OK)
+            status = decode_node_body(g, &idx);
+    }
+
+    return status == STATUS_NO_ITEM ? 0 : status;
+}
+
+/**
+ * Find the node of subject s in graph g,
+ * first looking at the last node, then in the subject index (if any).
+ *
+ * @return the offset of the node, 0 if not found or an error code
+ */
+ptrdiff_t find_subject(urdflib_t *g, const urdflib_t *s)
+{
+    if (g->last_node_idx > 0 && has_subject(g, g->last_node_idx, s))
+        return g->last_node_idx;
+
+#ifndef URDFLIB_NO_SUBJECT_INDEX
+    if (g->index == NULL)
+        g->index = index_create(g, allocator_of(g));
+
+    if (g->index != NULL)
+        return index_find(g->index, g, s);
+#endif
+
+    return scan_subject(g, s);
+}
+
+/**
+ * Find the pair of key p in the node starting at node_idx.
+ * If found, idx is set to the offset of the pair's value(s),
+ * otherwise to the offset of the node's break.
+ *
+ * @return STATUS_OK if found, STATUS_NO_ITEM if not found or an error code
+ */
+int find_pair(const urdflib_t *g, size_t node_idx, const urdflib_t *p, size_t *idx)
+{
+    int status;
+    urdflib_t key;
+
+    *idx = node_idx;
+    status = decode_node_start(g, idx, NULL);
+
+    while (status == STATUS_OK)
+    {
+        status = decode_key(g, idx, &key);
+
+        if (status == STATUS_OK && urdflib_cmp(&key, p) == 0)
+            return STATUS_OK;
+
+        if (status == STATUS_OK)
+            status = decode_values(g, idx);
+    }
+
+    return status;
+}
+
+/**
+ * Check whether the value(s) starting at idx in graph g include val.
+ */
+bool has_value(const urdflib_t *g, size_t idx, const urdflib_t *val)
+{
+    bool has_single_value;
+    urdflib_t v;
+
+    decode_values_start(g, &idx, &has_single_value);
+
+    while (decode_value(g, &idx, &v) == STATUS_OK)
+    {
+        if (urdflib_cmp(&v, val) == 0)
+            return true;
+        if (has_single_value)
+            break;
+    }
+
+    return false;
+}
+
+/*******************************************************************************
+ * Functions to read and write the subject directory of frozen graphs.
+ ******************************************************************************/
+
+/**
+ * The directory follows the graph as a second CBOR item (RFC 8742 sequence):
+ * 2021([h'<hash><offset>...', start]) with fixed-size integers,
+ * so that it can be located from the end of the buffer.
+ * Offsets and lengths take W = 4 bytes, or 8 bytes past 4 GiB (or with URDFLIB_WIDE_OFFSETS).
+ * Entries are sorted by (hash, offset) and compared as big-endian bytes.
+ */
+#define DIRECTORY_HEAD_SIZE(W) ((size_t)5 + (W))  // D9 07 E5 82 5A|5B <len:W>
+#define DIRECTORY_TAIL_SIZE(W) ((size_t)1 + (W))  // 1A|1B <start:W>
+#define DIRECTORY_ENTRY_SIZE(W) ((size_t)4 + (W)) // <hash:4> <offset:W>
+
+void store_uint(uint8_t *b, uint64_t v, uint8_t width)
+{
+    for (uint8_t i = width; i > 0; i--)
+    {
+        b[i - 1] = v;
+        v >>= 8;
+    }
+}
+
+uint64_t load_uint(const uint8_t *b, uint8_t width)
+{
+    uint64_t v = 0;
+
+    for (uint8_t i = 0; i < width; i++)
+        v = (v << 8) | b[i];
+
+    return v;
+}
+
+/**
+ * Width of the offsets of the directory starting at start,
+ * given by the initial byte of its byte string (0x5A or 0x5B).
+ */
+uint8_t directory_width(const urdflib_t *g, size_t start)
+{
+    return g->buffer[start + 4] == 0x5B ? 8 : 4;
+}
+
+/**
+ * Return the offset of a directory of graph g with offsets of the given width, or 0.
+ */
+size_t directory_start_with(const urdflib_t *g, uint8_t width)
+{
+    uint64_t start, len;
+    const uint8_t *head;
+
+    if (g->size < 2 + DIRECTORY_HEAD_SIZE(width) + DIRECTORY_TAIL_SIZE(width))
+        return 0;
+
+    if (g->buffer[g->size - DIRECTORY_TAIL_SIZE(width)] != (width == 8 ? 0x1B : 0x1A))
+        return 0;
+
+    start = load_uint(g->buffer + g->size - width, width);
+    if (start < 2 || start > g->size - DIRECTORY_HEAD_SIZE(width) - DIRECTORY_TAIL_SIZE(width))
+        return 0;
+
+    // 2021([h'...', start])
+    head = g->buffer + start;
+    if (head[0] != 0xD9 || head[1] != TAG_NB_DIRECTORY >> 8 || head[2] != (TAG_NB_DIRECTORY & 0xFF) ||
+        head[3] != 0x82 || head[4] != (width == 8 ? 0x5B : 0x5A))
+        return 0;
+
+    len = load_uint(head + 5, width);
+    if (len % DIRECTORY_ENTRY_SIZE(width) != 0 ||
+        len != g->size - start - DIRECTORY_HEAD_SIZE(width) - DIRECTORY_TAIL_SIZE(width))
+        return 0;
+
+    // { @graph: [ ... ] }
+    if (g->buffer[start - 1] != 0xFF || g->buffer[start - 2] != 0xFF)
+        return 0;
+
+    return start;
+}
+
+/**
+ * Return the offset of the directory of graph g (i.e. the size of the graph itself)
+ * or 0 if g has no directory.
+ */
+size_t directory_start(const urdflib_t *g)
+{
+    size_t start = directory_start_with(g, 4);
+
+    return start > 0 ? start : directory_start_with(g, 8);
+}
+
+/**
+ * Find the node of subject s by binary search in the directory of g.
+ *
+ * @return the offset of the node, 0 if not found
+ */
+size_t directory_find(const urdflib_t *g, size_t start, const urdflib_t *s)
+{
+    uint32_t hash;
+    uint8_t width;
+    size_t lo, hi, mid, count, entry_size, offset;
+    const uint8_t *entries;
+
+    width = directory_width(g, start);
+    entry_size = DIRECTORY_ENTRY_SIZE(width);
+    entries = g->buffer + start + DIRECTORY_HEAD_SIZE(width);
+    count = load_uint(g->buffer + start + 5, width) / entry_size;
+    hash = hash_buffer(s);
+
+    // first entry with hash
+    lo = 0;
+    hi = count;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (load_uint(entries + mid * entry_size, 4) < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (; lo < count && load_uint(entries + lo * entry_size, 4) == hash; lo++)
+    {
+        offset = load_uint(entries + lo * entry_size + 4, width);
+        if (offset < start && has_subject(g, offset, s))
+            return offset;
+    }
+
+    return 0;
+}
+
+int cmp_entries(const void *x, const void *y)
+{
+    return memcmp(x, y, DIRECTORY_ENTRY_SIZE(4));
+}
+
+int cmp_wide_entries(const void *x, const void *y)
+{
+    return memcmp(x, y, DIRECTORY_ENTRY_SIZE(8));
+}
+
+/**
+ * Append a directory of all subjects after graph g.
+ */
+int directory_append(urdflib_t *g)
+{
+    int status;
+    uint32_t hash;
+    uint8_t width;
+    size_t idx, node_idx, start, end, entry_size;
+    urdflib_t id;
+
+    start = g->size;
+
+#ifdef URDFLIB_WIDE_OFFSETS
+    width = 8;
+#else
+    width = (uint64_t)start > UINT32_MAX ? 8 : 4;
+#endif
+
+    entry_size = DIRECTORY_ENTRY_SIZE(width);
+    end = start + DIRECTORY_HEAD_SIZE(width);
+
+    idx = 0;
+    status = decode_graph_start(g, &idx, NULL);
+
+    while (status == STATUS_OK)
+    {
+        node_idx = idx;
+        status = decode_node_start(g, &idx, &id);
+
+        // id points into g, which may move
+        if (status == STATUS_OK)
+        {
+            hash = hash_buffer(&id);
+            status = reserve(g, end + entry_size + DIRECTORY_TAIL_SIZE(width));
+        }
+        if (status == STATUS_OK)
+        {
+            store_uint(g->buffer + end, hash, 4);
+            store_uint(g->buffer + end + 4, node_idx, width);
+            end += entry_size;
+            status = decode_node_body(g, &idx);
+        }
+    }
+
+    if (status != STATUS_NO_ITEM)
+        return status;
+
+    status = reserve(g, end + DIRECTORY_TAIL_SIZE(width));
+    if (status < STATUS_OK)
+        return status;
+
+    qsort(g->buffer + start + DIRECTORY_HEAD_SIZE(width), (end - start - DIRECTORY_HEAD_SIZE(width)) / entry_size,
+          entry_size, width == 8 ? cmp_wide_entries : cmp_entries);
+
+    // 2021([h'...', start])
+    g->buffer[start] = 0xD9;
+    g->buffer[start + 1] = TAG_NB_DIRECTORY >> 8;
+    g->buffer[start + 2] = TAG_NB_DIRECTORY & 0xFF;
+    g->buffer[start + 3] = 0x82;
+    g->buffer[start + 4] = width == 8 ? 0x5B : 0x5A;
+    store_uint(g->buffer + start + 5, end - start - DIRECTORY_HEAD_SIZE(width), width);
+    g->buffer[end] = width == 8 ? 0x1B : 0x1A;
+    store_uint(g->buffer + end + 1, start, width);
+
+    g->size = end + DIRECTORY_TAIL_SIZE(width);
+
+    return STATUS_OK;
+}
+
+/**
+ * Remove the directory of graph g (if any) before modifying it.
+ */
+void directory_drop(urdflib_t *g)
+{
+    size_t start = directory_start(g);
+
+    // buffers not owned by uRDFLib cannot be modified anyway
+    if (start > 0 && g->capacity > 0)
+        g->size = start;
+}
+
+/**
+ * Find the node of subject s in graph g, using index (if any)
+ * or the directory of g (if any), otherwise by scanning g.
+ *
+ * @return the offset of the node, 0 if not found or an error code
+ */
+ptrdiff_t lookup_subject(const urdflib_t *g, const struct urdflib_index *index, const urdflib_t *s)
+{
+    size_t start;
+
+    if (index != NULL)
+        return index_find(index, g, s);
+
+    start = directory_start(g);
+    if (start > 0)
+        return directory_find(g, start, s);
+
+    return scan_subject(g, s);
+}
+
+/*******************************************************************************
+ * Main functions of the uRDFLib module.
+ ******************************************************************************/
+
+/**
+ * Number of bytes of the CBOR head encoding argument v.
+ */
+size_t head_size(uint64_t v)
+{
+    if (v < 24)
+        return 1;
+    else if (v <= UINT8_MAX)
+        return 2;
+    else if (v <= UINT16_MAX)
+        return 3;
+    else if (v <= UINT32_MAX)
+        return 5;
+    else
+        return 9;
+}
+
+/**
+ * Point x to the given storage if it can hold size bytes.
+ * On error, x is left empty.
+ */
+int init_term(urdflib_t *x, uint8_t *buf, size_t buf_size, uint8_t type, size_t size)
+{
+    x->buffer = NULL;
+    x->size = 0;
+    x->type = type;
+    x->capacity = 0;
+    x->last_node_idx = 0;
+    x->index = NULL;
+    x->removed_size = 0;
+    x->alloc = NULL;
+
+    if (buf == NULL || buf_size < size)
+        return STATUS_BUFFER_ERROR;
+
+    x->buffer = buf;
+    x->size = size;
+
+    return STATUS_OK;
+}
+
+int urdflib_init_uriref(urdflib_t *x, uint8_t *buf, size_t size, urdflib_id_t id)
+{
+    int status;
+    size_t idx;
+
+    status = init_term(x, buf, size, TYPE_URIREF, head_size(id));
+    if (status < STATUS_OK)
+        return status;
+
+    idx = 0;
+    return encode_uriref(x, &idx, id);
+}
+
+int urdflib_init_uriref_curie(urdflib_t *x, uint8_t *buf, size_t size, urdflib_id_t ns_id, urdflib_id_t local_id)
+{
+    int status;
+    size_t idx;
+
+    // 320([ns_id, local_id])
+    status = init_term(x, buf, size, TYPE_URIREF, 4 + head_size(ns_id) + head_size(local_id));
+    if (status < STATUS_OK)
+        return status;
+
+    idx = 0;
+    return encode_uriref_curie(x, &idx, ns_id, local_id);
+}
+
+/**
+ * Generator used by urdflib_create_bnode() and urdflib_init_bnode().
+ */
+static urdflib_bnode_gen_t default_bnode_gen = {.next = 0};
+
+void urdflib_bnode_gen_init(urdflib_bnode_gen_t *gen, uint64_t first)
+{
+    gen->next = first;
+}
+
+/**
+ * Take the next identifier of a generator (atomically if the compiler supports it).
+ */
+uint64_t bnode_next_id(urdflib_bnode_gen_t *gen)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __atomic_fetch_add(&gen->next, 1, __ATOMIC_RELAXED);
+#else
+    return gen->next++;
+#endif
+}
+
+int urdflib_init_bnode(urdflib_t *x, uint8_t *buf, size_t size)
+{
+    return urdflib_init_bnode_with(x, buf, size, &default_bnode_gen);
+}
+
+int urdflib_init_bnode_with(urdflib_t *x, uint8_t *buf, size_t size, urdflib_bnode_gen_t *gen)
+{
+    int status;
+    size_t idx;
+    uint64_t id;
+
+    id = bnode_next_id(gen);
+
+    // 2020(id)
+    status = init_term(x, buf, size, TYPE_BNODE, 3 + head_size(id));
+    if (status < STATUS_OK)
+        return status;
+
+    idx = 0;
+    return encode_bnode(x, &idx, id);
+}
+
+int urdflib_init_literal(urdflib_t *x, uint8_t *buf, size_t size, const char *str)
+{
+    int status;
+    size_t idx, len;
+
+    len = strlen(str);
+
+    status = init_term(x, buf, size, TYPE_LITERAL, head_size(len) + len);
+    if (status < STATUS_OK)
+        return status;
+
+    idx = 0;
+    return encode_literal(x, &idx, str);
+}
+
+int urdflib_init_literal_float(urdflib_t *x, uint8_t *buf, size_t size, float nb)
+{
+    int status;
+    size_t idx;
+
+    // single-precision float: 1 byte for CBOR head + 4 bytes
+    status = init_term(x, buf, size, TYPE_LITERAL, 5);
+    if (status < STATUS_OK)
+        return status;
+
+    idx = 0;
+    return encode_literal_float(x, &idx, nb);
+}
+
+int urdflib_init_literal_date(urdflib_t *x, uint8_t *buf, size_t size, uint64_t unix_ts)
+{
+    int status;
+    size_t idx;
+
+    // 1(unix_ts)
+    status = init_term(x, buf, size, TYPE_LITERAL, 1 + head_size(unix_ts));
+    if (status < STATUS_OK)
+        return status;
+
+    idx = 0;
+    return encode_literal_date(x, &idx, unix_ts);
+}
+
+int urdflib_init_typed_literal(urdflib_t *x, uint8_t *buf, size_t size, const char *lex, const urdflib_t *dtype)
+{
+    int status;
+    size_t idx, len;
+
+    if (!is_uriref(dtype))
+    {
+        // leave x empty
+        init_term(x, NULL, 0, TYPE_LITERAL, 0);
+        return STATUS_ARG_ERROR;
+    }
+
+    len = strlen(lex);
+
+    // { @value: lex, @type: dtype }
+    status = init_term(x, buf, size, TYPE_LITERAL, 3 + head_size(len) + len + dtype->size);
+    if (status < STATUS_OK)
+        return status;
+
+    idx = 0;
+    return encode_typed_literal(x, &idx, lex, dtype);
+}
+
+int urdflib_init_variable(urdflib_t *x, uint8_t *buf, size_t size, urdflib_id_t var_idx)
+{
+    int status;
+    size_t idx;
+
+    // URDFLIB_ID_MAX marks the terms of triple patterns that are not variables
+    if (var_idx == URDFLIB_ID_MAX)
+    {
+        init_term(x, NULL, 0, TYPE_VARIABLE, 0);
+        return STATUS_ARG_ERROR;
+    }
+
+    // 2019(var_idx)
+    status = init_term(x, buf, size, TYPE_VARIABLE, 3 + head_size(var_idx));
+    if (status < STATUS_OK)
+        return status;
+
+    idx = 0;
+    return encode_variable(x, &idx, var_idx);
+}
+
+/**
+ * Take ownership of heap-allocated term x (or free its buffer on error).
+ */
+urdflib_t own_term(urdflib_t *x, uint8_t *buf, int status)
+{
+    if (status == STATUS_OK)
+    {
+        x->buffer = buf;
+        x->capacity = x->size;
+        x->alloc = default_allocator;
+    }
+    else
+    {
+        mem_free(default_allocator, buf, x->size);
+        x->buffer = NULL;
+        x->size = 0;
+    }
+
+    return *x;
+}
+
+urdflib_t urdflib_create_uriref(urdflib_id_t id)
+{
+    size_t size;
+    uint8_t *buf;
+    urdflib_t uriref;
+
+    size = head_size(id);
+    buf = mem_alloc(default_allocator, size);
+
+    return own_term(&uriref, buf, urdflib_init_uriref(&uriref, buf, size, id));
+}
+
+urdflib_t urdflib_create_uriref_curie(urdflib_id_t ns_id, urdflib_id_t local_id)
+{
+    size_t size;
+    uint8_t *buf;
+    urdflib_t uriref;
+
+    size = 4 + head_size(ns_id) + head_size(local_id);
+    buf = mem_alloc(default_allocator, size);
+
+    return own_term(&uriref, buf, urdflib_init_uriref_curie(&uriref, buf, size, ns_id, local_id));
+}
+
+urdflib_t urdflib_create_bnode()
+{
+    return urdflib_create_bnode_with(&default_bnode_gen);
+}
+
+urdflib_t urdflib_create_bnode_with(urdflib_bnode_gen_t *gen)
+{
+    uint8_t tmp[URDFLIB_TERM_SIZE];
+    uint8_t *buf;
+    urdflib_t bnode;
+
+    // identifier (hence size) is only known once encoded
+    if (urdflib_init_bnode_with(&bnode, tmp, URDFLIB_TERM_SIZE, gen) < STATUS_OK)
+        return bnode;
+
+    buf = mem_alloc(default_allocator, bnode.size);
+    if (buf != NULL)
+        memcpy(buf, tmp, bnode.size);
+
+    return own_term(&bnode, buf, buf != NULL ? STATUS_OK : STATUS_MALLOC_ERROR);
+}
+
+urdflib_t urdflib_create_literal(const char *str)
+{
+    size_t size, len;
+    uint8_t *buf;
+    urdflib_t lit;
+
+    len = strlen(str);
+    size = head_size(len) + len;
+    buf = mem_alloc(default_allocator, size);
+
+    return own_term(&lit, buf, urdflib_init_literal(&lit, buf, size, str));
+}
+
+urdflib_t urdflib_create_literal_float(float nb)
+{
+    uint8_t *buf;
+    urdflib_t lit;
+
+    buf = mem_alloc(default_allocator, 5);
+
+    return own_term(&lit, buf, urdflib_init_literal_float(&lit, buf, 5, nb));
+}
+
+urdflib_t urdflib_create_literal_date(uint64_t unix_ts)
+{
+    size_t size;
+    uint8_t *buf;
+    urdflib_t lit;
+
+    size = 1 + head_size(unix_ts);
+    buf = mem_alloc(default_allocator, size);
+
+    return own_term(&lit, buf, urdflib_init_literal_date(&lit, buf, size, unix_ts));
+}
+
+urdflib_t urdflib_create_typed_literal(const char *lex, const urdflib_t *dtype)
+{
+    size_t size, len;
+    uint8_t *buf;
+    urdflib_t lit;
+
+    len = strlen(lex);
+    size = 3 + head_size(len) + len + dtype->size;
+    buf = mem_alloc(default_allocator, size);
+
+    return own_term(&lit, buf, urdflib_init_typed_literal(&lit, buf, size, lex, dtype));
+}
+
+urdflib_t urdflib_create_variable(urdflib_id_t var_idx)
+{
+    size_t size;
+    uint8_t *buf;
+    urdflib_t var;
+
+    size = 3 + head_size(var_idx);
+    buf = mem_alloc(default_allocator, size);
+
+    return own_term(&var, buf, urdflib_init_variable(&var, buf, size, var_idx));
+}
+
+urdflib_t urdflib_create_graph()
+{
+    return urdflib_create_graph_with(NULL, default_allocator);
+}
+
+urdflib_t urdflib_create_named_graph(const urdflib_t *name)
+{
+    return urdflib_create_graph_with(name, default_allocator);
+}
+
+urdflib_t urdflib_create_graph_with(const urdflib_t *name, const urdflib_allocator_t *alloc)
+{
+    size_t idx;
+    urdflib_t g;
+
+    g.buffer = mem_alloc(alloc, BUFFER_SIZE);
+    g.size = BUFFER_SIZE;
+    g.type = TYPE_GRAPH;
+    g.capacity = BUFFER_SIZE;
+    g.last_node_idx = 0;
+    g.index = NULL;
+    g.removed_size = 0;
+    g.alloc = alloc;
+
+    if (g.buffer == NULL)
+    {
+        g.size = 0;
+        g.capacity = 0;
+        return g;
+    }
+
+    idx = 0;
+    encode_graph_start(&g, &idx, name);
+    g.size = idx;
+
+    return g;
+}
+
+/**
+ * Check the type of terms of a triple (or triple pattern, if variables are used).
+ */
+bool is_triple(const urdflib_t *s, const urdflib_t *p, const urdflib_t *o)
+{
+    return (is_uriref(s) || is_bnode(s) || is_variable(s)) &&
+           (is_uriref(p) || is_variable(p)) &&
+           (is_uriref(o) || is_bnode(o) || is_literal(o) || is_variable(o));
+}
+
+int add_triple(urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o, uint8_t options)
+{
+    int status, pair_status;
+    ptrdiff_t node_idx;
+    size_t idx, len, value_idx, value_size;
+    bool has_single_value;
+
+    if (!is_graph(g))
+        return STATUS_ARG_ERROR;
+    if (!is_triple(s, p, o))
+        return STATUS_ARG_ERROR;
+
+    node_idx = find_subject(g, s);
+    if (node_idx < 0)
+        return node_idx;
+
+    pair_status = STATUS_NO_ITEM;
+    has_single_value = true;
+    value_size = 0;
+
+    if (node_idx == 0)
+        // { @graph: [ ..., { @id: s, p: o } ] }
+        len = 3 + s->size + p->size + o->size;
+    else
+    {
+        pair_status = find_pair(g, node_idx, p, &idx);
+        if (pair_status < STATUS_NO_ITEM)
+            return pair_status;
+
+        if (pair_status == STATUS_OK && (options & URDFLIB_ADD_UNIQUE) && has_value(g, idx, o))
+            return STATUS_EXISTS;
+
+        if (pair_status == STATUS_NO_ITEM)
+            // { ..., p: o }
+            len = p->size + o->size;
+        else
+        {
+            value_idx = idx;
+            decode_values_start(g, &idx, &has_single_value);
+
+            do
+                status = decode_value(g, &idx, NULL);
+            while (status == STATUS_OK && !has_single_value);
+
+            if (has_single_value)
+            {
+                // { ..., p: v } becomes { ..., p: [ v, o ] }
+                value_size = idx - value_idx;
+                idx = value_idx;
+                len = 2 + o->size;
+            }
+            else if (status == STATUS_NO_ITEM)
+                // { ..., p: [ ..., o ] }
+                len = o->size;
+            else
+                return status;
+        }
+    }
+
+    // the graph is modified: its directory (if any) is dropped first
+    directory_drop(g);
+    if (node_idx == 0)
+        idx = g->size - 2;
+
+    status = insert_gap(g, idx, len);
+    if (status < STATUS_OK)
+        return status;
+
+    if (node_idx == 0)
+    {
+        g->last_node_idx = idx;
+        if (g->index != NULL && index_insert(g->index, hash_buffer(s), idx) < STATUS_OK)
+            index_delete(g);
+    }
+    // node_idx is not negative past find_subject()
+    else if ((size_t)node_idx != g->last_node_idx)
+    {
+        if (g->last_node_idx > idx)
+            g->last_node_idx += len;
+        if (g->index != NULL)
+            index_shift(g->index, idx, len);
+    }
+
+    if (node_idx == 0)
+        status = encode_node_start(g, &idx, s);
+
+    if (pair_status == STATUS_NO_ITEM)
+    {
+        status = encode_key(g, &idx, p);
+        status = encode_value(g, &idx, o);
+    }
+    else if (has_single_value)
+    {
+        // move existing value after array start
+        memmove(g->buffer + idx + 1, g->buffer + idx + len, value_size);
+
+        status = encode_values_start(g, &idx);
+        idx += value_size;
+        status = encode_value(g, &idx, o);
+        status = encode_values_end(g, &idx);
+    }
+    else
+        status = encode_value(g, &idx, o);
+
+    if (node_idx == 0)
+        status = encode_node_end(g, &idx);
+
+    return status;
+}
+
+/**
+ * Group of triples sharing the same subject in a call to urdflib_add_triples().
+ */
+typedef struct
+{
+    size_t first; // index of the first triple of the group
+    size_t count; // number of triples in the group
+    size_t start; // position of the group's first triple once triples are sorted
+    size_t pos;   // offset where the group's bytes are inserted
+    size_t len;   // number of bytes inserted
+    size_t shift; // number of bytes inserted by groups located before
+    bool is_new;  // if true, a new node is encoded
+    bool is_deferred; // if true, triples are added one by one
+} urdflib_group_t;
+
+int cmp_groups(const void *x, const void *y)
+{
+    const urdflib_group_t *a = x;
+    const urdflib_group_t *b = y;
+
+    if (a->pos != b->pos)
+        return a->pos < b->pos ? -1 : 1;
+
+    // groups of new nodes, in order of appearance
+    return a->first < b->first ? -1 : a->first > b->first;
+}
+
+/**
+ * Number of bytes by which an offset is shifted once groups (sorted by position) are inserted.
+ */
+size_t shift_of(const urdflib_group_t *groups, size_t nb_groups, size_t offset)
+{
+    size_t lo, hi, mid;
+
+    // find the first group located at or after offset
+    lo = 0;
+    hi = nb_groups;
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if (groups[mid].pos < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo == 0 ? 0 : groups[lo - 1].shift + groups[lo - 1].len;
+}
+
+/**
+ * Assign each triple to the group of its subject (in order of first appearance).
+ *
+ * @return the number of groups or an error code
+ */
+ptrdiff_t group_triples(const urdflib_allocator_t *alloc, const urdflib_t (*triples)[3], size_t n, size_t *group_ids, urdflib_group_t *groups)
+{
+    size_t *slots; // group index + 1 (0 if empty slot)
+    size_t capacity, i, j, nb_groups;
+    uint32_t hash;
+
+    capacity = INDEX_SIZE;
+    while (capacity < 2 * n)
+        capacity *= 2;
+
+    slots = mem_calloc(alloc, capacity, sizeof(size_t));
+    if (slots == NULL)
+        return STATUS_MALLOC_ERROR;
+
+    nb_groups = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        hash = hash_buffer(&triples[i][0]);
+
+        j = hash & (capacity - 1);
+        while (slots[j] > 0 && urdflib_cmp(&triples[groups[slots[j] - 1].first][0], &triples[i][0]) != 0)
+            j = (j + 1) & (capacity - 1);
+
+        if (slots[j] == 0)
+        {
+            groups[nb_groups].first = i;
+            groups[nb_groups].count = 0;
+            slots[j] = ++nb_groups;
+        }
+
+        group_ids[i] = slots[j] - 1;
+        groups[slots[j] - 1].count++;
+    }
+
+    mem_free(alloc, slots, capacity * sizeof(size_t));
+
+    return nb_groups;
+}
+
+/**
+ * Link triples of each group (once sorted by group) sharing the same predicate,
+ * in a single pass through a hash table keyed by group and predicate:
+ * firsts[i] is the position of the first triple with the predicate of triple i,
+ * nexts[i] the position of the next one (0 if none).
+ */
+int group_predicates(const urdflib_allocator_t *alloc, const urdflib_t (*triples)[3], const size_t *order,
+                     const urdflib_group_t *groups, size_t nb_groups, size_t n, size_t *firsts, size_t *nexts)
+{
+    size_t *slots; // position of the last triple + 1 (0 if empty slot)
+    size_t capacity, i, j, k, last;
+    const urdflib_t *p;
+
+    capacity = INDEX_SIZE;
+    while (capacity < 2 * n)
+        capacity *= 2;
+
+    slots = mem_calloc(alloc, capacity, sizeof(size_t));
+    if (slots == NULL)
+        return STATUS_MALLOC_ERROR;
+
+    for (k = 0; k < nb_groups; k++)
+        for (i = groups[k].start; i < groups[k].start + groups[k].count; i++)
+        {
+            p = &triples[order[i]][1];
+
+            // triples of previous groups are before groups[k].start
+            j = hash_displace(hash_buffer(p), k) & (capacity - 1);
+            while (slots[j] > 0 && (slots[j] - 1 < groups[k].start || urdflib_cmp(&triples[order[slots[j] - 1]][1], p) != 0))
+                j = (j + 1) & (capacity - 1);
+
+            firsts[i] = i;
+            nexts[i] = 0;
+            if (slots[j] > 0)
+            {
+                last = slots[j] - 1;
+                firsts[i] = firsts[last];
+                nexts[last] = i;
+            }
+            slots[j] = i + 1;
+        }
+
+    mem_free(alloc, slots, capacity * sizeof(size_t));
+
+    return STATUS_OK;
+}
+
+int urdflib_add_triple(urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o)
+{
+    return urdflib_add_triple_with(g, s, p, o, 0);
+}
+
+int urdflib_add_triple_with(urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o, uint8_t options)
+{
+#ifdef URDFLIB_STATS
+    int status;
+    uint64_t start = stats_clock();
+
+    status = add_triple(g, s, p, o, options);
+    stats.add_triple_calls++;
+    stats_latency(stats.add_triple_latency, start);
+
+    return status;
+#else
+    return add_triple(g, s, p, o, options);
+#endif
+}
+
+int urdflib_add_triples(urdflib_t *g, const urdflib_t (*triples)[3], size_t n)
+{
+    int status;
+    ptrdiff_t node_idx, grouped;
+    size_t i, j, k, idx, end, shift, total, nb_groups;
+    size_t *group_ids, *order, *firsts, *nexts, *counts;
+    urdflib_group_t *groups, *group;
+    const urdflib_t *t;
+    const urdflib_allocator_t *alloc;
+    bool has_last_node;
+
+    STATS_ADD(add_triples_calls, 1);
+
+    if (!is_graph(g))
+        return STATUS_ARG_ERROR;
+
+    for (i = 0; i < n; i++)
+        if (!is_triple(&triples[i][0], &triples[i][1], &triples[i][2]))
+            return STATUS_ARG_ERROR;
+
+    if (n == 0)
+        return STATUS_OK;
+
+    directory_drop(g);
+
+    alloc = allocator_of(g);
+    group_ids = mem_alloc(alloc, 4 * n * sizeof(size_t));
+    groups = mem_alloc(alloc, n * sizeof(urdflib_group_t));
+    if (group_ids == NULL || groups == NULL)
+    {
+        mem_free(alloc, groups, n * sizeof(urdflib_group_t));
+        mem_free(alloc, group_ids, 4 * n * sizeof(size_t));
+        return STATUS_MALLOC_ERROR;
+    }
+
+    order = group_ids + n;
+    firsts = group_ids + 2 * n;
+    nexts = group_ids + 3 * n;
+    counts = group_ids; // group ids not needed once triples are sorted
+
+    grouped = group_triples(alloc, triples, n, group_ids, groups);
+    status = grouped < 0 ? grouped : STATUS_OK;
+    nb_groups = grouped < 0 ? 0 : (size_t)grouped;
+
+    // sort triples by group (counting sort, stable)
+    total = 0;
+    for (k = 0; status == STATUS_OK && k < nb_groups; k++)
+    {
+        groups[k].start = total;
+        total += groups[k].count;
+        groups[k].count = 0;
+    }
+
+    for (i = 0; status == STATUS_OK && i < n; i++)
+    {
+        group = &groups[group_ids[i]];
+        order[group->start + group->count++] = i;
+    }
+
+    // several objects for the same predicate are grouped in an array
+    if (status == STATUS_OK)
+        status = group_predicates(alloc, triples, order, groups, nb_groups, n, firsts, nexts);
+
+    // compute where and how many bytes are inserted
+    total = 0;
+    for (k = 0; status == STATUS_OK && k < nb_groups; k++)
+    {
+        group = &groups[k];
+        group->len = 0;
+        group->is_deferred = false;
+
+        for (i = group->start; i < group->start + group->count; i++)
+        {
+            t = triples[order[i]];
+            counts[i] = 0;
+
+            if (firsts[i] == i)
+                group->len += t[1].size;
+            else
+                group->is_deferred = true;
+
+            if (++counts[firsts[i]] == 2)
+                group->len += 2;
+
+            group->len += t[2].size;
+        }
+
+        node_idx = find_subject(g, &triples[group->first][0]);
+
+        if (node_idx < 0)
+        {
+            status = node_idx;
+            break;
+        }
+
+        group->is_new = node_idx == 0;
+
+        if (group->is_new)
+        {
+            // { @graph: [ ..., { @id: s, ... } ] }
+            group->pos = g->size - 2;
+            group->len += 3 + triples[group->first][0].size;
+            group->is_deferred = false;
+        }
+        else if (!group->is_deferred)
+        {
+            // pairs appended before the node's break, unless keys already exist
+            for (i = group->start; i < group->start + group->count && status >= STATUS_NO_ITEM && !group->is_deferred; i++)
+            {
+                status = find_pair(g, node_idx, &triples[order[i]][1], &group->pos);
+                group->is_deferred = status == STATUS_OK;
+            }
+
+            if (status == STATUS_NO_ITEM)
+                status = STATUS_OK;
+        }
+
+        if (group->is_deferred)
+        {
+            // merged into existing pairs afterwards, one by one
+            group->pos = g->size - 2;
+            group->len = 0;
+        }
+
+        total += group->len;
+    }
+
+    if (status == STATUS_OK)
+        status = reserve(g, g->size + total);
+
+    if (status < STATUS_OK)
+    {
+        mem_free(alloc, groups, n * sizeof(urdflib_group_t));
+        mem_free(alloc, group_ids, 4 * n * sizeof(size_t));
+        return status;
+    }
+
+    qsort(groups, nb_groups, sizeof(urdflib_group_t), cmp_groups);
+
+    shift = 0;
+    for (k = 0; k < nb_groups; k++)
+    {
+        groups[k].shift = shift;
+        shift += groups[k].len;
+    }
+
+    // update offsets of existing nodes located after insertion points
+    if (g->index != NULL)
+        for (i = 0; i < g->index->capacity; i++)
+            if (g->index->slots[i].offset > 0)
+                g->index->slots[i].offset += shift_of(groups, nb_groups, g->index->slots[i].offset);
+
+    if (g->last_node_idx > 0)
+        g->last_node_idx += shift_of(groups, nb_groups, g->last_node_idx);
+
+    // single backward pass: move each segment once and encode inserted bytes
+    end = g->size;
+    g->size += total;
+    has_last_node = false;
+
+    for (k = nb_groups; k-- > 0;)
+    {
+        group = &groups[k];
+
+        memmove(g->buffer + group->pos + group->shift + group->len, g->buffer + group->pos, end - group->pos);
+        end = group->pos;
+
+        if (group->is_deferred)
+            continue;
+
+        idx = group->pos + group->shift;
+
+        if (group->is_new)
+        {
+            if (!has_last_node)
+                g->last_node_idx = idx;
+            has_last_node = true;
+
+            if (g->index != NULL && index_insert(g->index, hash_buffer(&triples[group->first][0]), idx) < STATUS_OK)
+                index_delete(g);
+
+            encode_node_start(g, &idx, &triples[group->first][0]);
+        }
+
+        for (i = group->start; i < group->start + group->count; i++)
+        {
+            if (firsts[i] != i)
+                continue;
+
+            encode_key(g, &idx, &triples[order[i]][1]);
+
+            if (counts[i] > 1)
+                encode_values_start(g, &idx);
+
+            // next positions are after i, so 0 ends the list
+            j = i;
+            do
+            {
+                encode_value(g, &idx, &triples[order[j]][2]);
+                j = nexts[j];
+            } while (j != 0);
+
+            if (counts[i] > 1)
+                encode_values_end(g, &idx);
+        }
+
+        if (group->is_new)
+            encode_node_end(g, &idx);
+    }
+
+    // groups whose keys already exist in their node
+    for (k = 0; k < nb_groups && status == STATUS_OK; k++)
+        for (i = groups[k].start; groups[k].is_deferred && i < groups[k].start + groups[k].count && status == STATUS_OK; i++)
+        {
+            t = triples[order[i]];
+            status = add_triple(g, &t[0], &t[1], &t[2], 0);
+        }
+
+    mem_free(alloc, groups, n * sizeof(urdflib_group_t));
+    mem_free(alloc, group_ids, 4 * n * sizeof(size_t));
+
+    return status;
+}
+
+int find_node(const urdflib_t *g, urdflib_ctx_t *ctx, urdflib_t *id)
+{
+    int status;
+    size_t node_idx;
+
+    if (!is_graph(g))
+        STATUS_ARG_ERROR;
+
+    if (ctx->idx == 0)
+        status = decode_graph_start(g, &(ctx->idx), NULL);
+
+    if (ctx->node_idx == 0)
+    {
+        ctx->node_idx = ctx->idx;
+        status = decode_node_start(g, &(ctx->idx), id);
+    }
+    else
+    {
+        node_idx = ctx->node_idx;
+        status = decode_node_start(g, &node_idx, id);
+    }
+
+    return status;
+}
+
+int find_key(const urdflib_t *g, urdflib_ctx_t *ctx, urdflib_t *key)
+{
+    int status;
+    size_t key_idx;
+
+    if (!is_graph(g))
+        STATUS_ARG_ERROR;
+
+    if (ctx->key_idx == 0)
+    {
+        ctx->key_idx = ctx->idx;
+        status = decode_key(g, &(ctx->idx), key);
+
+        if (status == STATUS_OK)
+            status = decode_values_start(g, &(ctx->idx), &(ctx->has_single_value));
+        else if (status == STATUS_NO_ITEM)
+            decode_node_end(g, &(ctx->idx));
+    }
+    else
+    {
+        key_idx = ctx->key_idx;
+        status = decode_key(g, &key_idx, key);
+    }
+
+    return status;
+}
+
+int find_value(const urdflib_t *g, urdflib_ctx_t *ctx, urdflib_t *val)
+{
+    int status;
+    size_t idx;
+
+    if (!is_graph(g))
+        STATUS_ARG_ERROR;
+
+    // values start decoded with key (see find_key)
+    status = decode_value(g, &(ctx->idx), val);
+
+    if (!ctx->has_single_value && status == STATUS_NO_ITEM)
+        decode_values_end(g, &(ctx->idx));
+
+    return status;
+}
+
+int find_next_triple(const urdflib_t *g, urdflib_ctx_t *ctx, urdflib_t *s, urdflib_t *p, urdflib_t *o)
+{
+    int status;
+
+    if (!is_graph(g))
+        STATUS_ARG_ERROR;
+
+    status = find_node(g, ctx, s);
+    if (status != STATUS_OK)
+        return status;
+
+    status = find_key(g, ctx, p);
+    if (status != STATUS_OK && status != STATUS_NO_ITEM)
+        return status;
+
+    if (status == STATUS_NO_ITEM)
+    {
+        ctx->node_idx = 0;
+        ctx->key_idx = 0;
+        return find_next_triple(g, ctx, s, p, o);
+    }
+
+    status = find_value(g, ctx, o);
+    if (status != STATUS_OK && status != STATUS_NO_ITEM)
+        return status;
+
+    if (ctx->has_single_value)
+        ctx->key_idx = 0;
+    else if (status == STATUS_NO_ITEM)
+    {
+        ctx->key_idx = 0;
+        return find_next_triple(g, ctx, s, p, o);
+    }
+
+    return status;
+}
+
+int urdflib_find_next_triple(const urdflib_t *g, urdflib_ctx_t *ctx, urdflib_t *s, urdflib_t *p, urdflib_t *o)
+{
+#ifdef URDFLIB_STATS
+    int status;
+    uint64_t start = stats_clock();
+
+    status = find_next_triple(g, ctx, s, p, o);
+    stats.find_next_triple_calls++;
+    stats_latency(stats.find_next_triple_latency, start);
+
+    return status;
+#else
+    return find_next_triple(g, ctx, s, p, o);
+#endif
+}
+
+urdflib_t urdflib_create_dataset()
+{
+    urdflib_t ds = urdflib_create_graph_with(NULL, default_allocator);
+
+    // { @graph: [ ... ] } holding named graphs
+    ds.type = TYPE_DATASET;
+
+    return ds;
+}
+
+int urdflib_add_graph(urdflib_t *ds, const urdflib_t *g)
+{
+    int status;
+    ptrdiff_t graph_idx;
+    size_t idx, len;
+    urdflib_t name, copy;
+
+    if (!is_dataset(ds) || !is_graph(g))
+        return STATUS_ARG_ERROR;
+
+    idx = 0;
+    status = decode_graph_start(g, &idx, &name);
+    if (status < STATUS_OK)
+        return status;
+    if (name.size == 0)
+        return STATUS_ARG_ERROR;
+
+    directory_drop(ds);
+
+    graph_idx = find_subject(ds, &name);
+    if (graph_idx < 0)
+        return graph_idx;
+    if (graph_idx > 0)
+        return STATUS_ARG_ERROR;
+
+    // graph without its directory (if any)
+    len = directory_start(g);
+    if (len == 0)
+        len = g->size;
+
+    // { @graph: [ ..., { @id: name, @graph: [ ... ] } ] }
+    idx = ds->size - 2;
+    status = insert_gap(ds, idx, len);
+    if (status < STATUS_OK)
+        return status;
+
+    memcpy(ds->buffer + idx, g->buffer, len);
+
+    // removed triples of g are compacted away in the copy
+    if (g->removed_size > 0)
+    {
+        memset(&copy, 0, sizeof(urdflib_t));
+        copy.buffer = ds->buffer + idx;
+        copy.size = len;
+        copy.capacity = len;
+        copy.type = TYPE_GRAPH;
+        copy.removed_size = g->removed_size;
+
+        status = urdflib_compact(&copy);
+
+        // ] }
+        memmove(ds->buffer + idx + copy.size, ds->buffer + idx + len, 2);
+        ds->size -= len - copy.size;
+        if (status < STATUS_OK)
+        {
+            memmove(ds->buffer + idx, ds->buffer + idx + copy.size, 2);
+            ds->size -= copy.size;
+            return status;
+        }
+    }
+
+    ds->last_node_idx = idx;
+    if (ds->index != NULL && index_insert(ds->index, hash_buffer(&name), idx) < STATUS_OK)
+        index_delete(ds);
+
+    return STATUS_OK;
+}
+
+/**
+ * Find the next triple of g matching s, p and o (NULL for any term).
+ * The node of a bound subject is looked up in index (if any) or by skipping
+ * other nodes after their @id only. Pairs whose key differs from a bound
+ * predicate are skipped without decoding their values.
+ */
+int find_triples(const urdflib_t *g, urdflib_ctx_t *ctx, const struct urdflib_index *index,
+                 const urdflib_t *s, const urdflib_t *p, const urdflib_t *o,
+                 urdflib_t *s_out, urdflib_t *p_out, urdflib_t *o_out)
+{
+    int status;
+    ptrdiff_t offset;
+    size_t idx, node_idx, key_idx;
+    urdflib_t id, key, val;
+
+    if (ctx->idx >= g->size)
+        return STATUS_NO_ITEM;
+
+    if (ctx->idx == 0 && s != NULL)
+    {
+        offset = lookup_subject(g, index, s);
+        if (offset < STATUS_OK)
+            return offset;
+
+        // subject not in g
+        ctx->idx = offset > 0 ? (size_t)offset : g->size;
+        if (offset == 0)
+            return STATUS_NO_ITEM;
+    }
+    else if (ctx->idx == 0)
+    {
+        status = decode_graph_start(g, &(ctx->idx), NULL);
+        if (status < STATUS_OK)
+            return status;
+    }
+
+    while (true)
+    {
+        // { @id: s, ... }
+        if (ctx->node_idx == 0)
+        {
+            // end of a range of nodes (see scan_range)
+            if (ctx->idx >= g->size)
+                return STATUS_NO_ITEM;
+
+            ctx->node_idx = ctx->idx;
+            status = decode_node_start(g, &(ctx->idx), &id);
+
+            // stay on the break of @graph (see urdflib_find_next_quad)
+            if (status == STATUS_NO_ITEM)
+                ctx->node_idx = 0;
+            if (status != STATUS_OK)
+                return status;
+        }
+
+        // { ..., p: o }
+        if (ctx->key_idx == 0)
+        {
+            idx = ctx->idx;
+            status = decode_key(g, &(ctx->idx), &key);
+
+            if (status == STATUS_NO_ITEM)
+            {
+                status = decode_node_end(g, &(ctx->idx));
+                ctx->node_idx = 0;
+                if (status < STATUS_OK)
+                    return status;
+
+                // a subject has a single node
+                if (s != NULL)
+                {
+                    ctx->idx = g->size;
+                    return STATUS_NO_ITEM;
+                }
+                continue;
+            }
+            if (status < STATUS_OK)
+                return status;
+
+            if (p != NULL && urdflib_cmp(p, &key) != 0)
+            {
+                STATS_ADD(pairs_skipped, 1);
+                status = decode_values(g, &(ctx->idx));
+                if (status < STATUS_OK)
+                    return status;
+                continue;
+            }
+
+            ctx->key_idx = idx;
+            decode_values_start(g, &(ctx->idx), &(ctx->has_single_value));
+        }
+
+        status = decode_value(g, &(ctx->idx), &val);
+
+        if (status == STATUS_NO_ITEM && !ctx->has_single_value)
+        {
+            ctx->key_idx = 0;
+            status = decode_values_end(g, &(ctx->idx));
+            if (status < STATUS_OK)
+                return status;
+            continue;
+        }
+        if (status < STATUS_OK)
+            return status;
+
+        key_idx = ctx->key_idx;
+        if (ctx->has_single_value)
+            ctx->key_idx = 0;
+
+        if (o != NULL && urdflib_cmp(o, &val) != 0)
+            continue;
+
+        if (s_out != NULL)
+        {
+            node_idx = ctx->node_idx;
+            decode_node_start(g, &node_idx, s_out);
+        }
+        if (p_out != NULL)
+            decode_key(g, &key_idx, p_out);
+        if (o_out != NULL)
+            *o_out = val;
+
+        return STATUS_OK;
+    }
+}
+
+int urdflib_find_triples(const urdflib_t *g, urdflib_ctx_t *ctx,
+                         const urdflib_t *s, const urdflib_t *p, const urdflib_t *o,
+                         urdflib_t *s_out, urdflib_t *p_out, urdflib_t *o_out)
+{
+    STATS_ADD(find_triples_calls, 1);
+
+    if (!is_graph(g))
+        return STATUS_ARG_ERROR;
+
+    return find_triples(g, ctx, g->index, s, p, o, s_out, p_out, o_out);
+}
+
+int urdflib_find_graph(const urdflib_t *ds, const urdflib_t *name, urdflib_t *g)
+{
+    int status;
+    ptrdiff_t graph_idx;
+    size_t idx;
+    urdflib_t id;
+
+    if (!is_dataset(ds))
+        return STATUS_ARG_ERROR;
+
+    graph_idx = lookup_subject(ds, ds->index, name);
+    if (graph_idx <= 0)
+        return graph_idx < 0 ? graph_idx : STATUS_NO_ITEM;
+
+    idx = graph_idx;
+    status = decode_node_start(ds, &idx, &id);
+    if (status == STATUS_OK)
+        status = decode_node_body(ds, &idx);
+    if (status < STATUS_OK)
+        return status;
+
+    init_term(g, ds->buffer + graph_idx, idx - graph_idx, TYPE_GRAPH, idx - graph_idx);
+
+    return STATUS_OK;
+}
+
+int urdflib_find_next_quad(const urdflib_t *ds, urdflib_ctx_t *ctx, urdflib_t *s, urdflib_t *p, urdflib_t *o, urdflib_t *g)
+{
+    int status;
+    size_t idx;
+    urdflib_t name, graph;
+
+    if (!is_dataset(ds))
+        return STATUS_ARG_ERROR;
+
+    // { @graph: [ ... ] }
+    if (ctx->graph_idx == 0)
+    {
+        status = decode_graph_start(ds, &(ctx->graph_idx), NULL);
+        if (status < STATUS_OK)
+            return status;
+    }
+
+    while (true)
+    {
+        // { @id: name, @graph: [ ... ] }
+        idx = ctx->graph_idx;
+        status = decode_node_start(ds, &idx, &name);
+        if (status != STATUS_OK)
+            return status;
+
+        if (idx + 1 >= ds->size || ds->buffer[idx] != KEYWORD_GRAPH || ds->buffer[idx + 1] != 0x9F)
+            return STATUS_BUFFER_ERROR;
+
+        // the named graph, bounded by the end of the dataset
+        init_term(&graph, ds->buffer + ctx->graph_idx, ds->size - ctx->graph_idx, TYPE_GRAPH, ds->size - ctx->graph_idx);
+
+        status = find_triples(&graph, ctx, NULL, NULL, NULL, NULL, s, p, o);
+        if (status != STATUS_NO_ITEM)
+            break;
+
+        // ctx->idx is on the break of @graph
+        status = decode_graph_end(&graph, &(ctx->idx));
+        if (status < STATUS_OK)
+            return status;
+
+        ctx->graph_idx += ctx->idx;
+        ctx->idx = 0;
+        ctx->node_idx = 0;
+        ctx->key_idx = 0;
+    }
+
+    if (status == STATUS_OK && g != NULL)
+        *g = name;
+
+    return status;
+}
+
+/*******************************************************************************
+ * Functions to remove triples from graphs.
+ ******************************************************************************/
+
+/**
+ * Overwrite the n bytes at idx in graph g with a tombstone of the same size:
+ * undefined (F7) for a single byte, otherwise a byte string
+ * whose payload is the rest of the removed bytes.
+ */
+void encode_tombstone(urdflib_t *g, size_t idx, size_t n)
+{
+    uint8_t *b = g->buffer + idx;
+    uint8_t width;
+
+    if (n == 1)
+        b[0] = 0xF7;
+    else if (n - 1 < 24)
+        b[0] = 0x40 | (n - 1);
+    else
+    {
+        width = n - 2 <= 0xFF ? 1 : n - 3 <= 0xFFFF ? 2 : n - 5 <= 0xFFFFFFFF ? 4 : 8;
+        b[0] = width == 1 ? 0x58 : width == 2 ? 0x59 : width == 4 ? 0x5A : 0x5B;
+        store_uint(b + 1, n - 1 - width, width);
+    }
+}
+
+/**
+ * Mark term x of graph g as removed.
+ */
+void remove_term(urdflib_t *g, const urdflib_t *x)
+{
+    encode_tombstone(g, x->buffer - g->buffer, x->size);
+    g->removed_size += x->size;
+}
+
+int urdflib_remove_triples(urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o)
+{
+    int status, count;
+    urdflib_ctx_t ctx = {0};
+    urdflib_t key, val;
+
+    if (!is_graph(g))
+        return STATUS_ARG_ERROR;
+
+    // buffer not owned by uRDFLib
+    if (g->capacity == 0)
+        return STATUS_BUFFER_ERROR;
+
+#ifndef URDFLIB_NO_SUBJECT_INDEX
+    if (s != NULL && g->index == NULL && directory_start(g) == 0)
+        g->index = index_create(g, allocator_of(g));
+#endif
+
+    // tombstones keep the offsets of the search valid
+    count = 0;
+    while ((status = find_triples(g, &ctx, g->index, s, p, o, NULL, &key, &val)) == STATUS_OK)
+    {
+        remove_term(g, &val);
+
+        // { ..., p: o } is removed as a whole, { ..., p: [ ... ] } is kept until compacted
+        if (ctx.has_single_value)
+            remove_term(g, &key);
+
+        count++;
+    }
+
+    STATS_ADD(triples_removed, count);
+
+    return status == STATUS_NO_ITEM ? count : status;
+}
+
+int urdflib_remove_triple(urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o)
+{
+    int count;
+
+    if (!is_triple(s, p, o))
+        return STATUS_ARG_ERROR;
+
+    // duplicates (if any) are removed as well
+    count = urdflib_remove_triples(g, s, p, o);
+    if (count < STATUS_OK)
+        return count;
+
+    return count > 0 ? STATUS_OK : STATUS_NO_ITEM;
+}
+
+/**
+ * State of a compaction: live bytes are moved down in runs,
+ * each run being moved once (when the next live bytes do not follow it).
+ */
+typedef struct
+{
+    urdflib_t *g;
+    size_t size;     // number of bytes moved so far
+    size_t run_idx;  // offset of the run of live bytes not moved yet
+    size_t run_size; // size of the run
+} urdflib_compactor_t;
+
+void compact_flush(urdflib_compactor_t *c)
+{
+    if (c->size != c->run_idx)
+        memmove(c->g->buffer + c->size, c->g->buffer + c->run_idx, c->run_size);
+
+    c->size += c->run_size;
+    c->run_size = 0;
+}
+
+/**
+ * Keep the n bytes at idx after the bytes kept so far.
+ *
+ * @return the offset of the bytes once compacted
+ */
+size_t compact_keep(urdflib_compactor_t *c, size_t idx, size_t n)
+{
+    if (idx != c->run_idx + c->run_size)
+    {
+        compact_flush(c);
+        c->run_idx = idx;
+    }
+
+    c->run_size += n;
+
+    return c->size + c->run_size - n;
+}
+
+/**
+ * Keep the start of the node at node_idx (up to pairs_idx), unless already kept.
+ * Nodes whose pairs were all removed are never kept.
+ */
+void compact_node(urdflib_compactor_t *c, size_t node_idx, size_t pairs_idx, bool *has_pairs)
+{
+    if (*has_pairs)
+        return;
+
+    c->g->last_node_idx = compact_keep(c, node_idx, pairs_idx - node_idx);
+    *has_pairs = true;
+}
+
+int urdflib_compact(urdflib_t *g)
+{
+    int status;
+    size_t idx, node_idx, pairs_idx, values_idx, end_idx, nb_values;
+    bool has_directory, has_pairs, has_single_value;
+    urdflib_compactor_t c;
+    urdflib_t key, val, first;
+
+    if (!is_graph(g))
+        return STATUS_ARG_ERROR;
+
+    if (g->removed_size == 0)
+        return STATUS_OK;
+
+    has_directory = directory_start(g) > 0;
+    directory_drop(g);
+
+    c.g = g;
+    c.size = 0;
+    c.run_idx = 0;
+    c.run_size = 0;
+    first.buffer = NULL;
+    first.size = 0;
+
+    // { @graph: [
+    idx = 0;
+    status = decode_graph_start(g, &idx, NULL);
+    if (status < STATUS_OK)
+        return status;
+
+    compact_keep(&c, 0, idx);
+    g->last_node_idx = 0;
+
+    while (status == STATUS_OK)
+    {
+        // { @id: s, ... }
+        node_idx = idx;
+        status = decode_node_start(g, &idx, NULL);
+        if (status != STATUS_OK)
+            break;
+
+        pairs_idx = idx;
+        has_pairs = false;
+
+        while ((status = decode_key(g, &idx, &key)) == STATUS_OK)
+        {
+            values_idx = idx;
+            decode_values_start(g, &idx, &has_single_value);
+            nb_values = 0;
+
+            while ((status = decode_value(g, &idx, &val)) == STATUS_OK)
+            {
+                if (++nb_values == 1)
+                    first = val;
+                else
+                {
+                    // p: [ first, val, ... ]
+                    if (nb_values == 2)
+                    {
+                        compact_node(&c, node_idx, pairs_idx, &has_pairs);
+                        compact_keep(&c, key.buffer - g->buffer, key.size);
+                        compact_keep(&c, values_idx, 1);
+                        compact_keep(&c, first.buffer - g->buffer, first.size);
+                    }
+                    compact_keep(&c, val.buffer - g->buffer, val.size);
+                }
+
+                if (has_single_value)
+                    break;
+            }
+
+            end_idx = idx;
+            if (status == STATUS_NO_ITEM && !has_single_value)
+                status = decode_values_end(g, &idx);
+            if (status < STATUS_OK)
+                return status;
+
+            // p: first (without array if others were removed)
+            if (nb_values == 1)
+            {
+                compact_node(&c, node_idx, pairs_idx, &has_pairs);
+                compact_keep(&c, key.buffer - g->buffer, key.size);
+                compact_keep(&c, first.buffer - g->buffer, first.size);
+            }
+            else if (nb_values > 1)
+                compact_keep(&c, end_idx, 1);
+        }
+
+        // }
+        end_idx = idx;
+        if (status == STATUS_NO_ITEM)
+            status = decode_node_end(g, &idx);
+        if (status == STATUS_OK && has_pairs)
+            compact_keep(&c, end_idx, 1);
+    }
+
+    // ] }
+    end_idx = idx;
+    if (status == STATUS_NO_ITEM)
+        status = decode_graph_end(g, &idx);
+    if (status < STATUS_OK)
+        return status;
+
+    compact_keep(&c, end_idx, idx - end_idx);
+    compact_flush(&c);
+
+    STATS_ADD(bytes_compacted, g->size - c.size);
+
+    g->size = c.size;
+    g->removed_size = 0;
+
+    // node offsets changed
+    index_delete(g);
+
+    if (has_directory)
+        return directory_append(g);
+
+    return STATUS_OK;
+}
+
+/*******************************************************************************
+ * Functions to parse graphs arriving in chunks.
+ ******************************************************************************/
+
+/**
+ * States of incremental parsers, i.e. the next expected token(s).
+ */
+#define PARSER_GRAPH_START 0 // {
+#define PARSER_GRAPH_KEY 1   // @id or @graph
+#define PARSER_GRAPH_NAME 2  // name of a named graph
+#define PARSER_NODES 3       // [
+#define PARSER_NODE_START 4  // { or ]
+#define PARSER_NODE_ID 5     // @id
+#define PARSER_SUBJECT 6     // subject
+#define PARSER_KEY 7         // key or }
+#define PARSER_VALUES 8      // [ or value
+#define PARSER_VALUE 9       // value or ]
+#define PARSER_GRAPH_END 10  // }
+#define PARSER_DONE 11
+
+void urdflib_parser_init(urdflib_parser_t *parser)
+{
+    memset(parser, 0, sizeof(urdflib_parser_t));
+    parser->state = PARSER_GRAPH_START;
+}
+
+void urdflib_parser_feed(urdflib_parser_t *parser, const uint8_t *chunk, size_t size)
+{
+    parser->input = chunk;
+    parser->input_size = size;
+    parser->input_idx = 0;
+}
+
+/**
+ * Skip the payload of the byte string whose head (of head_size bytes) is at b
+ * in the parser's buffer, across chunks if needed.
+ * The token returned holds the head only.
+ */
+int parser_skip_tombstone(urdflib_parser_t *parser, const uint8_t *b, size_t head_size, urdflib_token_t *token)
+{
+    size_t len;
+    uint64_t value = head_value(b);
+
+    len = parser->input_size - parser->input_idx;
+    if (len > value - parser->skipped_size)
+        len = value - parser->skipped_size;
+
+    parser->input_idx += len;
+    parser->skipped_size += len;
+    if (parser->skipped_size < value)
+        return STATUS_NEED_INPUT;
+
+    token->type = TOKEN_BYTE_STRING;
+    token->buffer = (uint8_t *)b;
+    token->size = head_size;
+    token->value = value;
+    parser->token_size += head_size;
+
+    return STATUS_OK;
+}
+
+/**
+ * Copy the next token from the input to the parser's buffer, after the complete tokens
+ * of the term being read. Only the bytes needed to complete the token are copied.
+ */
+int parser_read_token(urdflib_parser_t *parser, urdflib_token_t *token)
+{
+    size_t start, have, need, len;
+    uint64_t value;
+    uint8_t *b;
+    urdflib_t view;
+
+    start = parser->subject_size + parser->key_size + parser->token_size;
+    b = parser->buffer + start;
+
+    while (true)
+    {
+        have = parser->term_size - parser->token_size;
+        need = 1;
+
+        if (have > 0)
+        {
+            if (ARG_SIZES[b[0] & 0x1F] == ARG_INVALID)
+                return STATUS_CBOR_ERROR;
+            need += ARG_SIZES[b[0] & 0x1F];
+        }
+
+        // tombstones of removed terms (see encode_tombstone): payloads are skipped, never buffered
+        if (have >= need && b[0] >> 5 == 2 && (b[0] & 0x1F) != 31 && parser->token_size == 0 &&
+            (parser->state == PARSER_KEY || parser->state == PARSER_VALUE))
+            return parser_skip_tombstone(parser, b, need, token);
+
+        // definite-length strings are read at once
+        if (have >= need && (b[0] >> 5 == 2 || b[0] >> 5 == 3) && (b[0] & 0x1F) != 31)
+        {
+            value = head_value(b);
+            if (value > URDFLIB_PARSER_SIZE)
+                return STATUS_BUFFER_ERROR;
+            need += value;
+        }
+
+        if (need > URDFLIB_PARSER_SIZE - start)
+            return STATUS_BUFFER_ERROR;
+
+        if (have >= need)
+            break;
+
+        if (parser->input_idx >= parser->input_size)
+            return STATUS_NEED_INPUT;
+
+        len = need - have;
+        if (len > parser->input_size - parser->input_idx)
+            len = parser->input_size - parser->input_idx;
+
+        memcpy(b + have, parser->input + parser->input_idx, len);
+        parser->input_idx += len;
+        parser->term_size += len;
+    }
+
+    init_term(&view, b, need, TYPE_LITERAL, need);
+    start = 0;
+    parser->token_size += need;
+
+    return decode_token(&view, &start, token);
+}
+
+/**
+ * Discard the token or term just read.
+ */
+void parser_consume(urdflib_parser_t *parser)
+{
+    parser->term_size = 0;
+    parser->token_size = 0;
+    parser->skipped_size = 0;
+}
+
+/**
+ * Decode a term held in the parser's buffer.
+ */
+int parser_term(const urdflib_parser_t *parser, size_t start, size_t size, urdflib_t *term)
+{
+    int status;
+    size_t idx;
+    urdflib_t view;
+
+    init_term(&view, (uint8_t *)parser->buffer + start, size, TYPE_LITERAL, size);
+    init_term(term, NULL, 0, TYPE_LITERAL, 0);
+
+    idx = 0;
+    status = decode_value(&view, &idx, term);
+    if (status == STATUS_OK && idx != size)
+        return STATUS_BUFFER_ERROR;
+
+    return status;
+}
+
+/**
+ * Add the token just read to the term being read.
+ * CURIEs and other tagged terms span several tokens.
+ *
+ * @return STATUS_OK once the term is complete, STATUS_NO_ITEM if more tokens are needed or an error code
+ */
+int parser_add_token(urdflib_parser_t *parser, const urdflib_token_t *token, urdflib_t *term)
+{
+    // first token of the term
+    if (parser->token_size == token->size)
+        parser->nb_tokens = is_curie_tag(token) ? 3 : token->type == TOKEN_TAG ? 1 : 0;
+    else
+        parser->nb_tokens--;
+
+    if (parser->nb_tokens > 0)
+        return STATUS_NO_ITEM;
+
+    return parser_term(parser, parser->subject_size + parser->key_size, parser->token_size, term);
+}
+
+int urdflib_parser_next(urdflib_parser_t *parser, urdflib_t *s, urdflib_t *p, urdflib_t *o)
+{
+    int status;
+    bool is_first;
+    uint8_t *term_buf;
+    urdflib_token_t token;
+    urdflib_t term;
+
+    while (parser->state != PARSER_DONE)
+    {
+        status = parser_read_token(parser, &token);
+        if (status < STATUS_OK)
+            return status;
+
+        is_first = parser->token_size == token.size;
+        term_buf = parser->buffer + parser->subject_size + parser->key_size;
+
+        switch (parser->state)
+        {
+        case PARSER_GRAPH_START:
+            // { ... }
+            if (token.type != TOKEN_INDEF_MAP_START)
+                return STATUS_BUFFER_ERROR;
+            parser_consume(parser);
+            parser->state = PARSER_GRAPH_KEY;
+            break;
+
+        case PARSER_GRAPH_KEY:
+            // { @id: name, @graph: [ ... ] }
+            if (is_keyword(&token, KEYWORD_ID))
+                parser->state = PARSER_GRAPH_NAME;
+            else if (is_keyword(&token, KEYWORD_GRAPH))
+                parser->state = PARSER_NODES;
+            else
+                return STATUS_BUFFER_ERROR;
+            parser_consume(parser);
+            break;
+
+        case PARSER_GRAPH_NAME:
+            status = parser_add_token(parser, &token, &term);
+            if (status < STATUS_NO_ITEM)
+                return status;
+            if (status == STATUS_OK)
+            {
+                parser_consume(parser);
+                parser->state = PARSER_GRAPH_KEY;
+            }
+            break;
+
+        case PARSER_NODES:
+            if (token.type != TOKEN_INDEF_ARRAY_START)
+                return STATUS_BUFFER_ERROR;
+            parser_consume(parser);
+            parser->state = PARSER_NODE_START;
+            break;
+
+        case PARSER_NODE_START:
+            // { @id: s, ... } or end of @graph
+            if (token.type == TOKEN_INDEF_MAP_START)
+                parser->state = PARSER_NODE_ID;
+            else if (token.type == TOKEN_INDEF_BREAK)
+                parser->state = PARSER_GRAPH_END;
+            else
+                return STATUS_BUFFER_ERROR;
+            parser_consume(parser);
+            break;
+
+        case PARSER_NODE_ID:
+            if (!is_keyword(&token, KEYWORD_ID))
+                return STATUS_BUFFER_ERROR;
+            parser_consume(parser);
+            parser->state = PARSER_SUBJECT;
+            break;
+
+        case PARSER_SUBJECT:
+            status = parser_add_token(parser, &token, &term);
+            if (status < STATUS_NO_ITEM)
+                return status;
+            if (status == STATUS_OK)
+            {
+                // subject kept at the start of the buffer
+                memmove(parser->buffer, term_buf, parser->token_size);
+                parser->subject_size = parser->token_size;
+                parser->key_size = 0;
+                parser_consume(parser);
+                parser->state = PARSER_KEY;
+            }
+            break;
+
+        case PARSER_KEY:
+            // { ..., p: o }
+            if (is_first && is_tombstone(&token))
+            {
+                // removed pair (see urdflib_remove_triples)
+                parser_consume(parser);
+                break;
+            }
+            if (is_first && token.type == TOKEN_INDEF_BREAK)
+            {
+                parser_consume(parser);
+                parser->state = PARSER_NODE_START;
+                break;
+            }
+
+            status = parser_add_token(parser, &token, &term);
+            if (status < STATUS_NO_ITEM)
+                return status;
+            if (status == STATUS_OK)
+            {
+                if (!is_uriref(&term) && !is_variable(&term))
+                    return STATUS_BUFFER_ERROR;
+                memmove(parser->buffer + parser->subject_size, term_buf, parser->token_size);
+                parser->key_size = parser->token_size;
+                parser_consume(parser);
+                parser->state = PARSER_VALUES;
+            }
+            break;
+
+        case PARSER_VALUES:
+        case PARSER_VALUE:
+            // { ..., p: [ o, ... ] }
+            if (is_first && parser->state == PARSER_VALUES && token.type == TOKEN_INDEF_ARRAY_START)
+            {
+                parser_consume(parser);
+                parser->state = PARSER_VALUE;
+                break;
+            }
+            if (is_first && parser->state == PARSER_VALUE && token.type == TOKEN_INDEF_BREAK)
+            {
+                parser_consume(parser);
+                parser->state = PARSER_KEY;
+                break;
+            }
+            if (is_first && parser->state == PARSER_VALUE && is_tombstone(&token))
+            {
+                parser_consume(parser);
+                break;
+            }
+
+            status = parser_add_token(parser, &token, o);
+            if (status < STATUS_NO_ITEM)
+                return status;
+            if (status == STATUS_OK)
+            {
+                // o remains in the buffer until the next call
+                parser_consume(parser);
+                if (parser->state == PARSER_VALUES)
+                    parser->state = PARSER_KEY;
+
+                parser_term(parser, 0, parser->subject_size, s);
+                parser_term(parser, parser->subject_size, parser->key_size, p);
+
+                return STATUS_OK;
+            }
+            break;
+
+        case PARSER_GRAPH_END:
+            if (token.type != TOKEN_INDEF_BREAK)
+                return STATUS_BUFFER_ERROR;
+            parser_consume(parser);
+            parser->state = PARSER_DONE;
+            break;
+        }
+    }
+
+    // bytes after the graph (e.g. its directory) are ignored
+    return STATUS_NO_ITEM;
+}
+
+/*******************************************************************************
+ * Functions to encode graphs to a sink.
+ ******************************************************************************/
+
+void urdflib_writer_init(urdflib_writer_t *writer, int (*write)(void *state, const uint8_t *data, size_t size), void *state)
+{
+    memset(writer, 0, sizeof(urdflib_writer_t));
+    writer->write = write;
+    writer->state = state;
+}
+
+/**
+ * Write the first len staged bytes to the sink.
+ */
+int writer_flush(urdflib_writer_t *writer, size_t len)
+{
+    int status;
+
+    status = writer->write(writer->state, writer->buffer, len);
+    if (status < STATUS_OK)
+        return status;
+
+    memmove(writer->buffer, writer->buffer + len, writer->size - len);
+    writer->size -= len;
+    writer->pair_idx -= len;
+
+    return STATUS_OK;
+}
+
+/**
+ * Ensure len bytes can be staged, flushing staged bytes if needed
+ * (except a pair with a single value, which may become an array).
+ */
+int writer_reserve(urdflib_writer_t *writer, size_t len)
+{
+    int status;
+    size_t keep_idx;
+
+    if (writer->size + len <= URDFLIB_WRITER_SIZE)
+        return STATUS_OK;
+
+    keep_idx = writer->has_pair && !writer->has_values ? writer->pair_idx : writer->size;
+    if (keep_idx > 0)
+    {
+        status = writer_flush(writer, keep_idx);
+        if (status < STATUS_OK)
+            return status;
+    }
+
+    if (writer->size + len > URDFLIB_WRITER_SIZE)
+        return STATUS_BUFFER_ERROR;
+
+    return STATUS_OK;
+}
+
+/**
+ * Return the staging buffer of a writer as a buffer for encode_* functions.
+ */
+urdflib_t writer_view(urdflib_writer_t *writer)
+{
+    urdflib_t view;
+
+    init_term(&view, writer->buffer, URDFLIB_WRITER_SIZE, TYPE_GRAPH, URDFLIB_WRITER_SIZE);
+
+    return view;
+}
+
+/**
+ * Encode the end of the last pair (if its values are an array).
+ */
+int writer_end_pair(urdflib_writer_t *writer)
+{
+    int status;
+    urdflib_t view = writer_view(writer);
+
+    if (writer->has_pair && writer->has_values)
+    {
+        status = writer_reserve(writer, 1);
+        if (status < STATUS_OK)
+            return status;
+        encode_values_end(&view, &writer->size);
+    }
+
+    writer->has_pair = false;
+    writer->has_values = false;
+
+    return STATUS_OK;
+}
+
+/**
+ * Encode the end of the last node (if any).
+ */
+int writer_end_node(urdflib_writer_t *writer)
+{
+    int status;
+    urdflib_t view = writer_view(writer);
+
+    status = writer_end_pair(writer);
+    if (status < STATUS_OK)
+        return status;
+
+    if (writer->has_node)
+    {
+        status = writer_reserve(writer, 1);
+        if (status < STATUS_OK)
+            return status;
+        encode_node_end(&view, &writer->size);
+    }
+
+    writer->has_node = false;
+
+    return STATUS_OK;
+}
+
+int urdflib_write_graph_start(urdflib_writer_t *writer, const urdflib_t *name)
+{
+    int status;
+    urdflib_t view = writer_view(writer);
+
+    if (name != NULL && (!is_uriref(name) && !is_bnode(name) && !is_variable(name)))
+        return STATUS_ARG_ERROR;
+
+    // { @id: name, @graph: [ ] }
+    status = writer_reserve(writer, 6 + (name != NULL ? name->size : 0));
+    if (status < STATUS_OK)
+        return status;
+
+    encode_graph_start(&view, &writer->size, name);
+
+    // breaks written by urdflib_write_graph_end
+    writer->size -= 2;
+
+    return STATUS_OK;
+}
+
+int urdflib_write_triple(urdflib_writer_t *writer, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o)
+{
+    int status;
+    bool is_same_subject;
+    size_t value_idx;
+    urdflib_t view = writer_view(writer);
+
+    if (!is_triple(s, p, o) || s->size > URDFLIB_TERM_SIZE || p->size > URDFLIB_TERM_SIZE)
+        return STATUS_ARG_ERROR;
+
+    is_same_subject = writer->has_node && writer->subject_size == s->size &&
+                      memcmp(writer->subject, s->buffer, s->size) == 0;
+
+    if (is_same_subject && writer->has_pair && writer->key_size == p->size &&
+        memcmp(writer->key, p->buffer, p->size) == 0)
+    {
+        status = writer_reserve(writer, (writer->has_values ? 0 : 1) + o->size);
+        if (status < STATUS_OK)
+            return status;
+
+        if (!writer->has_values)
+        {
+            // { ..., p: v } becomes { ..., p: [ v, o ] }
+            value_idx = writer->pair_idx + writer->key_size;
+            memmove(writer->buffer + value_idx + 1, writer->buffer + value_idx, writer->size - value_idx);
+            writer->size++;
+            encode_values_start(&view, &value_idx);
+            writer->has_values = true;
+        }
+
+        return encode_value(&view, &writer->size, o);
+    }
+
+    if (is_same_subject)
+        status = writer_end_pair(writer);
+    else
+        status = writer_end_node(writer);
+    if (status < STATUS_OK)
+        return status;
+
+    if (!is_same_subject)
+    {
+        // { @id: s, ... }
+        status = writer_reserve(writer, 2 + s->size);
+        if (status < STATUS_OK)
+            return status;
+
+        encode_node_start(&view, &writer->size, s);
+        memcpy(writer->subject, s->buffer, s->size);
+        writer->subject_size = s->size;
+        writer->has_node = true;
+    }
+
+    // { ..., p: o }
+    status = writer_reserve(writer, p->size + o->size);
+    if (status < STATUS_OK)
+        return status;
+
+    writer->pair_idx = writer->size;
+    encode_key(&view, &writer->size, p);
+    encode_value(&view, &writer->size, o);
+    memcpy(writer->key, p->buffer, p->size);
+    writer->key_size = p->size;
+    writer->has_pair = true;
+
+    return STATUS_OK;
+}
+
+int urdflib_write_graph_end(urdflib_writer_t *writer)
+{
+    int status;
+    urdflib_t view = writer_view(writer);
+
+    status = writer_end_node(writer);
+    if (status < STATUS_OK)
+        return status;
+
+    status = writer_reserve(writer, 2);
+    if (status < STATUS_OK)
+        return status;
+
+    encode_graph_end(&view, &writer->size);
+
+    return writer_flush(writer, writer->size);
+}
+
+/*******************************************************************************
+ * Functions to merge and sort graphs.
+ ******************************************************************************/
+
+/**
+ * Node of a graph being merged: offsets of its start, first pair and end.
+ */
+typedef struct
+{
+    size_t node_idx;
+    size_t pairs_idx;
+    size_t end;
+    urdflib_t id;
+} urdflib_node_t;
+
+/**
+ * State of a merge of graph a and graph b: blank node identifiers of a
+ * (open addressing, identifier + 1 stored, 0 for empty slots).
+ * Blank nodes of b also found in a are renamed by adding max_bnode to their identifier.
+ */
+typedef struct
+{
+    const urdflib_t *a;
+    const urdflib_t *b;
+    urdflib_t *out;
+    const urdflib_allocator_t *alloc;
+    uint64_t *bnodes;
+    size_t capacity;
+    size_t count;
+    uint64_t max_bnode; // largest identifier + 1 (0 if no blank node)
+    bool has_collisions;
+} urdflib_merge_t;
+
+int next_node(const urdflib_t *g, size_t *idx, urdflib_node_t *node)
+{
+    int status;
+
+    node->node_idx = *idx;
+    status = decode_node_start(g, idx, &node->id);
+    if (status < STATUS_OK)
+        return status;
+
+    node->pairs_idx = *idx;
+    status = decode_node_body(g, idx);
+    node->end = *idx;
+
+    return status;
+}
+
+uint64_t bnode_id(const urdflib_t *x)
+{
+    size_t idx;
+    urdflib_token_t token;
+
+    // 2020(id)
+    idx = 0;
+    decode_token(x, &idx, &token);
+    decode_token(x, &idx, &token);
+
+    return token.value;
+}
+
+size_t bnode_slot(const urdflib_merge_t *m, uint64_t id)
+{
+    size_t i = hash_displace((uint32_t)id ^ (uint32_t)(id >> 32), 0) & (m->capacity - 1);
+
+    while (m->bnodes[i] != 0 && m->bnodes[i] != id + 1)
+        i = (i + 1) & (m->capacity - 1);
+
+    return i;
+}
+
+int merge_add_bnode(urdflib_merge_t *m, uint64_t id)
+{
+    uint64_t *bnodes = m->bnodes;
+    size_t capacity = m->capacity;
+    size_t i;
+
+    if (2 * (m->count + 1) > m->capacity)
+    {
+        m->bnodes = mem_calloc(m->alloc, 2 * capacity, sizeof(uint64_t));
+        if (m->bnodes == NULL)
+        {
+            m->bnodes = bnodes;
+            return STATUS_MALLOC_ERROR;
+        }
+
+        m->capacity = 2 * capacity;
+        for (i = 0; i < capacity; i++)
+            if (bnodes[i] != 0)
+                m->bnodes[bnode_slot(m, bnodes[i] - 1)] = bnodes[i];
+        mem_free(m->alloc, bnodes, capacity * sizeof(uint64_t));
+    }
+
+    i = bnode_slot(m, id);
+    if (m->bnodes[i] == 0)
+    {
+        m->bnodes[i] = id + 1;
+        m->count++;
+    }
+
+    return STATUS_OK;
+}
+
+bool merge_has_bnode(const urdflib_merge_t *m, uint64_t id)
+{
+    return m->bnodes[bnode_slot(m, id)] != 0;
+}
+
+/**
+ * Record the blank node identifier of term x, found in the first graph if is_first.
+ */
+int merge_scan_term(urdflib_merge_t *m, const urdflib_t *x, bool is_first)
+{
+    uint64_t id;
+
+    if (!is_bnode(x))
+        return STATUS_OK;
+
+    // renamed identifiers (max_bnode + id) must not overflow
+    id = bnode_id(x);
+    if (id > UINT64_MAX / 2)
+        return STATUS_ARG_ERROR;
+
+    if (id >= m->max_bnode)
+        m->max_bnode = id + 1;
+
+    if (is_first)
+        return merge_add_bnode(m, id);
+
+    if (merge_has_bnode(m, id))
+        m->has_collisions = true;
+
+    return STATUS_OK;
+}
+
+/**
+ * Walk all terms of graph g, recording blank nodes
+ * and checking whether nodes are sorted by subject.
+ * This is a first pass over g: how nodes are merged depends on both scans,
+ * so the merge itself walks g a second time.
+ */
+int merge_scan(urdflib_merge_t *m, const urdflib_t *g, bool is_first, bool *is_sorted)
+{
+    int status;
+    size_t idx;
+    bool has_single_value;
+    urdflib_t id, prev, key, val;
+
+    *is_sorted = true;
+    prev.buffer = NULL;
+    prev.size = 0;
+
+    idx = 0;
+    status = decode_graph_start(g, &idx, NULL);
+
+    while (status == STATUS_OK && (status = decode_node_start(g, &idx, &id)) == STATUS_OK)
+    {
+        if (prev.size > 0 && cmp_terms(&prev, &id) >= 0)
+            *is_sorted = false;
+        prev = id;
+
+        status = merge_scan_term(m, &id, is_first);
+
+        while (status == STATUS_OK && (status = decode_key(g, &idx, &key)) == STATUS_OK)
+        {
+            decode_values_start(g, &idx, &has_single_value);
+
+            do
+                status = decode_value(g, &idx, &val);
+            while (status == STATUS_OK && (status = merge_scan_term(m, &val, is_first)) == STATUS_OK &&
+                   !has_single_value);
+
+            if (status == STATUS_NO_ITEM && !has_single_value)
+                status = decode_values_end(g, &idx);
+        }
+
+        if (status == STATUS_NO_ITEM)
+            status = decode_node_end(g, &idx);
+    }
+
+    return status == STATUS_NO_ITEM ? STATUS_OK : status;
+}
+
+/**
+ * Append n bytes to the merged graph.
+ */
+int merge_copy(urdflib_merge_t *m, const uint8_t *b, size_t n)
+{
+    int status;
+
+    status = insert_gap(m->out, m->out->size, n);
+    if (status < STATUS_OK)
+        return status;
+
+    memcpy(m->out->buffer + m->out->size - n, b, n);
+
+    return STATUS_OK;
+}
+
+/**
+ * Append the bytes of graph g between idx and end,
+ * counting the tombstones of removed terms they hold.
+ */
+int merge_copy_range(urdflib_merge_t *m, const urdflib_t *g, size_t idx, size_t end)
+{
+    int status;
+    size_t start;
+    urdflib_token_t token;
+
+    status = merge_copy(m, g->buffer + idx, end - idx);
+
+    while (status == STATUS_OK && g->removed_size > 0 && idx < end)
+    {
+        start = idx;
+        if (decode_token(g, &idx, &token) < STATUS_OK)
+            return STATUS_BUFFER_ERROR;
+        if (is_tombstone(&token))
+            m->out->removed_size += idx - start;
+    }
+
+    return status;
+}
+
+/**
+ * Check whether blank node x of the second graph is renamed.
+ */
+bool is_renamed(const urdflib_merge_t *m, const urdflib_t *x)
+{
+    return m->has_collisions && is_bnode(x) && merge_has_bnode(m, bnode_id(x));
+}
+
+/**
+ * Append term x (of a if is_first, of b otherwise), renaming it if needed.
+ */
+int merge_term(urdflib_merge_t *m, const urdflib_t *x, bool is_first)
+{
+    int status;
+    size_t idx, len;
+    uint64_t id;
+
+    if (is_first || !is_renamed(m, x))
+        return merge_copy(m, x->buffer, x->size);
+
+    // 2020(id)
+    id = m->max_bnode + bnode_id(x);
+    len = 3 + head_size(id);
+
+    status = insert_gap(m->out, m->out->size, len);
+    if (status < STATUS_OK)
+        return status;
+
+    idx = m->out->size - len;
+    return encode_bnode(m->out, &idx, id);
+}
+
+/**
+ * Append the value(s) starting at idx in graph g (a if is_first, b otherwise).
+ * If a_idx is not 0, the values of b are merged with the values of a starting at a_idx:
+ * a's values are appended first, then values of b not found in a.
+ */
+int merge_values(urdflib_merge_t *m, const urdflib_t *g, size_t *idx, bool is_first, size_t a_idx)
+{
+    int status;
+    size_t start, out_start, nb_values, a_end;
+    bool has_single_value;
+    urdflib_t val;
+
+    start = *idx;
+    status = decode_values(g, idx);
+    if (status < STATUS_OK)
+        return status;
+
+    if (a_idx == 0 && (is_first || !m->has_collisions))
+        return merge_copy_range(m, g, start, *idx);
+
+    // [ a's values, other values ]
+    out_start = m->out->size;
+    status = merge_copy(m, (const uint8_t *)"\x9F", 1);
+    nb_values = 0;
+
+    if (a_idx > 0)
+    {
+        a_end = a_idx;
+        decode_values_start(m->a, &a_end, &has_single_value);
+
+        while (status == STATUS_OK && (status = decode_value(m->a, &a_end, &val)) == STATUS_OK)
+        {
+            status = merge_copy(m, val.buffer, val.size);
+            nb_values++;
+            if (has_single_value)
+                break;
+        }
+        if (status == STATUS_NO_ITEM)
+            status = STATUS_OK;
+    }
+
+    *idx = start;
+    decode_values_start(g, idx, &has_single_value);
+
+    while (status == STATUS_OK && (status = decode_value(g, idx, &val)) == STATUS_OK)
+    {
+        if (a_idx == 0 || is_renamed(m, &val) || !has_value(m->a, a_idx, &val))
+        {
+            status = merge_term(m, &val, is_first);
+            nb_values++;
+        }
+        if (has_single_value)
+            break;
+    }
+
+    if (status == STATUS_NO_ITEM)
+        status = decode_values_end(g, idx);
+    if (status < STATUS_OK)
+        return status;
+
+    // values all removed: nothing is appended (see merge_pair)
+    if (nb_values == 0)
+    {
+        m->out->size = out_start;
+        return STATUS_OK;
+    }
+
+    if (nb_values > 1)
+        return merge_copy(m, (const uint8_t *)"\xFF", 1);
+
+    // a single value is not wrapped in an array
+    memmove(m->out->buffer + out_start, m->out->buffer + out_start + 1, m->out->size - out_start - 1);
+    m->out->size--;
+
+    return STATUS_OK;
+}
+
+/**
+ * Append key and the value(s) starting at idx in graph g (see merge_values).
+ * The pair is dropped if all its values were removed.
+ */
+int merge_pair(urdflib_merge_t *m, const urdflib_t *key, const urdflib_t *g, size_t *idx, bool is_first, size_t a_idx)
+{
+    int status;
+    size_t key_idx = m->out->size;
+
+    status = merge_copy(m, key->buffer, key->size);
+    if (status == STATUS_OK)
+        status = merge_values(m, g, idx, is_first, a_idx);
+
+    if (status == STATUS_OK && m->out->size == key_idx + key->size)
+        m->out->size = key_idx;
+
+    return status;
+}
+
+/**
+ * Append a node (of a if is_first, of b otherwise).
+ * A node of a is merged with the node of the same subject in b, if other is not NULL.
+ */
+int merge_node(urdflib_merge_t *m, const urdflib_node_t *node, bool is_first, const urdflib_node_t *other)
+{
+    int status, pair_status;
+    size_t idx, other_idx, node_idx, pairs_idx, last_node_idx;
+    const urdflib_t *g = is_first ? m->a : m->b;
+    urdflib_t key;
+
+    last_node_idx = m->out->last_node_idx;
+    node_idx = m->out->size;
+    m->out->last_node_idx = node_idx;
+
+    if (other == NULL && (is_first || !m->has_collisions))
+        return merge_copy_range(m, g, node->node_idx, node->end);
+
+    // { @id: s, ... }
+    status = merge_copy(m, g->buffer + node->node_idx, node->pairs_idx - node->node_idx - node->id.size);
+    if (status == STATUS_OK)
+        status = merge_term(m, &node->id, is_first);
+    if (status < STATUS_OK)
+        return status;
+
+    pairs_idx = m->out->size;
+
+    // pairs of g, merged with the pair of the same key in the other node (if any)
+    idx = node->pairs_idx;
+    while ((status = decode_key(g, &idx, &key)) == STATUS_OK)
+    {
+        pair_status = STATUS_NO_ITEM;
+        if (other != NULL)
+            pair_status = find_pair(m->b, other->node_idx, &key, &other_idx);
+
+        if (pair_status == STATUS_OK)
+        {
+            status = merge_pair(m, &key, m->b, &other_idx, false, idx);
+            if (status == STATUS_OK)
+                status = decode_values(g, &idx);
+        }
+        else if (pair_status < STATUS_NO_ITEM)
+            status = pair_status;
+        else
+            status = merge_pair(m, &key, g, &idx, is_first, 0);
+
+        if (status < STATUS_OK)
+            return status;
+    }
+
+    // other pairs of the other node
+    if (status == STATUS_NO_ITEM && other != NULL)
+    {
+        idx = other->pairs_idx;
+        while ((status = decode_key(m->b, &idx, &key)) == STATUS_OK)
+        {
+            pair_status = find_pair(m->a, node->node_idx, &key, &other_idx);
+
+            if (pair_status == STATUS_OK)
+                status = decode_values(m->b, &idx);
+            else if (pair_status == STATUS_NO_ITEM)
+                status = merge_pair(m, &key, m->b, &idx, false, 0);
+            else
+                status = pair_status;
+
+            if (status < STATUS_OK)
+                return status;
+        }
+    }
+
+    if (status != STATUS_NO_ITEM)
+        return status;
+
+    // nodes whose pairs were all removed are dropped
+    if (m->out->size == pairs_idx)
+    {
+        m->out->size = node_idx;
+        m->out->last_node_idx = last_node_idx;
+        return STATUS_OK;
+    }
+
+    return merge_copy(m, (const uint8_t *)"\xFF", 1);
+}
+
+/**
+ * Merge sorted graphs (without blank node collisions) node by node, keeping nodes sorted.
+ */
+int merge_sorted(urdflib_merge_t *m)
+{
+    int status, status_a, status_b, c;
+    size_t idx_a, idx_b;
+    urdflib_node_t node_a, node_b;
+
+    idx_a = 0;
+    idx_b = 0;
+    status_a = decode_graph_start(m->a, &idx_a, NULL);
+    status_b = decode_graph_start(m->b, &idx_b, NULL);
+    if (status_a < STATUS_OK || status_b < STATUS_OK)
+        return STATUS_BUFFER_ERROR;
+
+    status_a = next_node(m->a, &idx_a, &node_a);
+    status_b = next_node(m->b, &idx_b, &node_b);
+    status = STATUS_OK;
+
+    while (status == STATUS_OK && (status_a == STATUS_OK || status_b == STATUS_OK))
+    {
+        if (status_a == STATUS_OK && status_b == STATUS_OK)
+            c = cmp_terms(&node_a.id, &node_b.id);
+        else
+            c = status_a == STATUS_OK ? -1 : 1;
+
+        if (c <= 0)
+            status = merge_node(m, &node_a, true, c == 0 ? &node_b : NULL);
+        else
+            status = merge_node(m, &node_b, false, NULL);
+
+        if (c <= 0)
+            status_a = next_node(m->a, &idx_a, &node_a);
+        if (c >= 0)
+            status_b = next_node(m->b, &idx_b, &node_b);
+    }
+
+    if (status_a < STATUS_NO_ITEM)
+        return status_a;
+    if (status_b < STATUS_NO_ITEM)
+        return status_b;
+
+    return status;
+}
+
+/**
+ * Merge graphs through subject lookups: nodes of a (merged with nodes of the same subject in b),
+ * then the other nodes of b. Blank node subjects are never merged, as blank nodes of b
+ * also found in a are renamed.
+ */
+int merge_unsorted(urdflib_merge_t *m, const struct urdflib_index *index_a, const struct urdflib_index *index_b)
+{
+    int status;
+    ptrdiff_t other_idx;
+    size_t idx;
+    urdflib_node_t node, other;
+
+    idx = 0;
+    status = decode_graph_start(m->a, &idx, NULL);
+
+    while (status == STATUS_OK && (status = next_node(m->a, &idx, &node)) == STATUS_OK)
+    {
+        other_idx = is_bnode(&node.id) ? 0 : lookup_subject(m->b, index_b, &node.id);
+        if (other_idx < 0)
+            return other_idx;
+
+        if (other_idx > 0)
+        {
+            other.node_idx = other_idx;
+            other.pairs_idx = other_idx;
+            status = decode_node_start(m->b, &other.pairs_idx, &other.id);
+        }
+        if (status == STATUS_OK)
+            status = merge_node(m, &node, true, other_idx > 0 ? &other : NULL);
+    }
+
+    if (status != STATUS_NO_ITEM)
+        return status;
+
+    idx = 0;
+    status = decode_graph_start(m->b, &idx, NULL);
+
+    while (status == STATUS_OK && (status = next_node(m->b, &idx, &node)) == STATUS_OK)
+    {
+        other_idx = is_bnode(&node.id) ? 0 : lookup_subject(m->a, index_a, &node.id);
+        if (other_idx < 0)
+            return other_idx;
+
+        // nodes found in a are already merged
+        if (other_idx == 0)
+            status = merge_node(m, &node, false, NULL);
+    }
+
+    return status == STATUS_NO_ITEM ? STATUS_OK : status;
+}
+
+/**
+ * Subject index of graph g for the duration of a merge,
+ * unless g already has an index or a directory (NULL if not needed).
+ */
+struct urdflib_index *merge_index(const urdflib_t *g, const urdflib_allocator_t *alloc)
+{
+    if (g->index != NULL || directory_start(g) > 0)
+        return NULL;
+
+    return index_create(g, alloc);
+}
+
+int urdflib_graph_merge(const urdflib_t *a, const urdflib_t *b, urdflib_t *out)
+{
+    int status;
+    size_t idx;
+    bool is_sorted_a, is_sorted_b;
+    struct urdflib_index *index_a, *index_b;
+    urdflib_merge_t m;
+    urdflib_t name;
+
+    if (!is_graph(a) || !is_graph(b))
+        return STATUS_ARG_ERROR;
+
+    idx = 0;
+    status = decode_graph_start(a, &idx, &name);
+    if (status < STATUS_OK)
+        return status;
+
+    memset(&m, 0, sizeof(urdflib_merge_t));
+    m.a = a;
+    m.b = b;
+    m.out = out;
+    m.alloc = a->alloc != NULL ? a->alloc : default_allocator;
+    m.capacity = INDEX_SIZE;
+    m.bnodes = mem_calloc(m.alloc, m.capacity, sizeof(uint64_t));
+
+    *out = urdflib_create_graph_with(name.size > 0 ? &name : NULL, m.alloc);
+    if (m.bnodes == NULL || out->buffer == NULL)
+        status = STATUS_MALLOC_ERROR;
+
+    if (status == STATUS_OK)
+        status = merge_scan(&m, a, true, &is_sorted_a);
+    if (status == STATUS_OK)
+        status = merge_scan(&m, b, false, &is_sorted_b);
+
+    // { @graph: [ ... ] } without its breaks
+    if (status == STATUS_OK)
+    {
+        status = reserve(out, out->size + a->size + b->size);
+        out->size -= 2;
+    }
+
+    if (status == STATUS_OK && is_sorted_a && is_sorted_b && !m.has_collisions)
+        status = merge_sorted(&m);
+    else if (status == STATUS_OK)
+    {
+        index_a = merge_index(a, m.alloc);
+        index_b = merge_index(b, m.alloc);
+
+        status = merge_unsorted(&m, index_a != NULL ? index_a : a->index, index_b != NULL ? index_b : b->index);
+
+        index_free(index_a);
+        index_free(index_b);
+    }
+
+    if (status == STATUS_OK)
+        status = merge_copy(&m, (const uint8_t *)"\xFF\xFF", 2);
+
+    mem_free(m.alloc, m.bnodes, m.capacity * sizeof(uint64_t));
+
+    if (status < STATUS_OK)
+        urdflib_delete(out);
+
+    return status;
+}
+
+/**
+ * Pair of a node being sorted: its key and the offsets of its value(s).
+ */
+typedef struct
+{
+    urdflib_t key;
+    size_t values_idx;
+    size_t end;
+} urdflib_pair_t;
+
+int cmp_nodes(const void *x, const void *y)
+{
+    const urdflib_node_t *a = x;
+    const urdflib_node_t *b = y;
+    int c = cmp_terms(&a->id, &b->id);
+
+    // nodes of the same subject (if any) keep their order
+    if (c != 0)
+        return c;
+
+    return a->node_idx < b->node_idx ? -1 : a->node_idx > b->node_idx;
+}
+
+int cmp_pairs(const void *x, const void *y)
+{
+    return cmp_terms(&((const urdflib_pair_t *)x)->key, &((const urdflib_pair_t *)y)->key);
+}
+
+int cmp_values(const void *x, const void *y)
+{
+    return cmp_terms(x, y);
+}
+
+/**
+ * Ensure array items (of capacity items of the given size) can hold n items.
+ */
+int grow_array(const urdflib_allocator_t *alloc, void **items, size_t *capacity, size_t n, size_t size)
+{
+    size_t new_capacity;
+    void *new_items;
+
+    if (n <= *capacity)
+        return STATUS_OK;
+
+    new_capacity = *capacity > 0 ? *capacity : INDEX_SIZE;
+    while (new_capacity < n)
+        new_capacity *= 2;
+
+    STATS_ADD(reallocations, 1);
+    new_items = alloc->reallocate(alloc->state, *items, *capacity * size, new_capacity * size);
+    if (new_items == NULL)
+        return STATUS_MALLOC_ERROR;
+
+    *items = new_items;
+    *capacity = new_capacity;
+
+    return STATUS_OK;
+}
+
+/**
+ * Write the pairs of a node into buffer out, sorted by key with sorted values.
+ * Scratch arrays of pairs and values grow as needed.
+ */
+int sort_pairs(const urdflib_t *g, const urdflib_node_t *node, uint8_t *out, size_t *out_idx,
+               const urdflib_allocator_t *alloc, urdflib_pair_t **pairs, size_t *nb_pairs, urdflib_t **values, size_t *nb_values)
+{
+    int status;
+    size_t i, j, k, n, count, idx;
+    bool has_single_value;
+    urdflib_t key;
+
+    // { @id: s, k: v, ... }
+    n = 0;
+    idx = node->pairs_idx;
+    while ((status = decode_key(g, &idx, &key)) == STATUS_OK)
+    {
+        status = grow_array(alloc, (void **)pairs, nb_pairs, n + 1, sizeof(urdflib_pair_t));
+        if (status < STATUS_OK)
+            return status;
+
+        (*pairs)[n].key = key;
+        (*pairs)[n].values_idx = idx;
+        status = decode_values(g, &idx);
+        if (status < STATUS_OK)
+            return status;
+        (*pairs)[n++].end = idx;
+    }
+
+    if (status != STATUS_NO_ITEM)
+        return status;
+
+    qsort(*pairs, n, sizeof(urdflib_pair_t), cmp_pairs);
+
+    for (i = 0; i < n; i++)
+    {
+        count = 0;
+        idx = (*pairs)[i].values_idx;
+        decode_values_start(g, &idx, &has_single_value);
+
+        do
+        {
+            status = grow_array(alloc, (void **)values, nb_values, count + 1, sizeof(urdflib_t));
+            if (status == STATUS_OK)
+                status = decode_value(g, &idx, &(*values)[count]);
+            if (status == STATUS_OK)
+                count++;
+        } while (status == STATUS_OK && !has_single_value);
+
+        if (status < STATUS_NO_ITEM)
+            return status;
+
+        qsort(*values, count, sizeof(urdflib_t), cmp_values);
+
+        // duplicate values are dropped
+        for (j = 1, k = 1; j < count; j++)
+            if (cmp_terms(&(*values)[k - 1], &(*values)[j]) != 0)
+                (*values)[k++] = (*values)[j];
+        count = count > 0 ? k : 0;
+
+        // pairs without any value (p: [ ]) are dropped
+        if (count == 0)
+            continue;
+
+        memcpy(out + *out_idx, (*pairs)[i].key.buffer, (*pairs)[i].key.size);
+        *out_idx += (*pairs)[i].key.size;
+
+        if (count > 1)
+            out[(*out_idx)++] = 0x9F;
+        for (j = 0; j < count; j++)
+        {
+            memcpy(out + *out_idx, (*values)[j].buffer, (*values)[j].size);
+            *out_idx += (*values)[j].size;
+        }
+        if (count > 1)
+            out[(*out_idx)++] = 0xFF;
+    }
+
+    return STATUS_OK;
+}
+
+/**
+ * Rewrite graph g in canonical order (see URDFLIB_FREEZE_SORTED).
+ */
+int sort_graph(urdflib_t *g)
+{
+    int status;
+    size_t idx, start, out_idx, node_idx, pairs_idx, last_node_idx, n, i, capacity, nb_pairs, nb_values;
+    uint8_t *out;
+    urdflib_node_t *nodes;
+    urdflib_pair_t *pairs;
+    urdflib_t *values;
+    const urdflib_allocator_t *alloc;
+
+    // buffer not owned by uRDFLib
+    if (g->capacity == 0)
+        return STATUS_BUFFER_ERROR;
+
+    alloc = allocator_of(g);
+    directory_drop(g);
+
+    // { @id: name, @graph: [
+    idx = 0;
+    status = decode_graph_start(g, &idx, NULL);
+    if (status < STATUS_OK)
+        return status;
+
+    start = idx;
+    nodes = NULL;
+    capacity = 0;
+    n = 0;
+
+    while ((status = grow_array(alloc, (void **)&nodes, &capacity, n + 1, sizeof(urdflib_node_t))) == STATUS_OK &&
+           (status = next_node(g, &idx, &nodes[n])) == STATUS_OK)
+        n++;
+
+    out = NULL;
+    if (status == STATUS_NO_ITEM)
+    {
+        status = STATUS_OK;
+        out = mem_alloc(alloc, g->size);
+        if (out == NULL)
+            status = STATUS_MALLOC_ERROR;
+    }
+
+    pairs = NULL;
+    values = NULL;
+    nb_pairs = 0;
+    nb_values = 0;
+
+    if (status == STATUS_OK)
+    {
+        qsort(nodes, n, sizeof(urdflib_node_t), cmp_nodes);
+
+        memcpy(out, g->buffer, start);
+        out_idx = start;
+        last_node_idx = 0;
+
+        for (i = 0; i < n && status == STATUS_OK; i++)
+        {
+            node_idx = out_idx;
+
+            // { @id: s, ... }
+            memcpy(out + out_idx, g->buffer + nodes[i].node_idx, nodes[i].pairs_idx - nodes[i].node_idx);
+            out_idx += nodes[i].pairs_idx - nodes[i].node_idx;
+            pairs_idx = out_idx;
+
+            status = sort_pairs(g, &nodes[i], out, &out_idx, alloc, &pairs, &nb_pairs, &values, &nb_values);
+
+            // nodes without any pair are dropped (as by urdflib_compact)
+            if (out_idx == pairs_idx)
+            {
+                out_idx = node_idx;
+                continue;
+            }
+
+            out[out_idx++] = 0xFF;
+            last_node_idx = node_idx;
+        }
+
+        // ] }
+        out[out_idx++] = 0xFF;
+        out[out_idx++] = 0xFF;
+    }
+
+    if (status == STATUS_OK)
+    {
+        mem_free(alloc, g->buffer, g->capacity);
+        g->buffer = out;
+        g->capacity = g->size;
+        g->size = out_idx;
+        g->last_node_idx = last_node_idx;
+    }
+    else
+        mem_free(alloc, out, g->size);
+
+    mem_free(alloc, values, nb_values * sizeof(urdflib_t));
+    mem_free(alloc, pairs, nb_pairs * sizeof(urdflib_pair_t));
+    mem_free(alloc, nodes, capacity * sizeof(urdflib_node_t));
+
+    return status;
+}
+
+/*******************************************************************************
+ * Functions to translate IRIs to terms and back.
+ ******************************************************************************/
+
+/**
+ * Marker for empty slots of perfect hash tables.
+ */
+#define DICT_EMPTY UINT32_MAX
+
+/**
+ * Average number of keys per bucket of perfect hash tables.
+ */
+#define DICT_BUCKET_SIZE 4
+
+/**
+ * Number of displacements tried for a bucket before giving up.
+ */
+#define DICT_MAX_DISPLACEMENT (1u << 20)
+
+/**
+ * Bucket of a perfect hash table and its number of keys.
+ */
+typedef struct
+{
+    uint32_t bucket;
+    uint32_t size;
+} urdflib_bucket_t;
+
+int cmp_buckets(const void *x, const void *y)
+{
+    const urdflib_bucket_t *a = x;
+    const urdflib_bucket_t *b = y;
+
+    // largest buckets first
+    if (a->size != b->size)
+        return a->size > b->size ? -1 : 1;
+
+    return a->bucket < b->bucket ? -1 : a->bucket > b->bucket;
+}
+
+bool is_same_key(const uint8_t *keys, const uint32_t *offsets, uint32_t i, uint32_t j)
+{
+    return offsets[i + 1] - offsets[i] == offsets[j + 1] - offsets[j] &&
+           memcmp(keys + offsets[i], keys + offsets[j], offsets[i + 1] - offsets[i]) == 0;
+}
+
+/**
+ * Build a minimal-search perfect hash table (hash and displace):
+ * keys are grouped in buckets and, largest bucket first,
+ * the first displacement placing all keys of the bucket in free slots is kept.
+ *
+ * @return a status code (STATUS_ARG_ERROR if a key is given twice)
+ */
+int perfect_hash_build(const urdflib_allocator_t *alloc, size_t n, const uint8_t *keys, const uint32_t *offsets,
+                       size_t nb_buckets, size_t nb_slots, uint32_t *displacements, uint32_t *slots)
+{
+    int status;
+    uint32_t *hashes, *order, *starts, *positions;
+    urdflib_bucket_t *buckets;
+    uint32_t b, d, k, start, size;
+    bool is_placed;
+
+    hashes = mem_alloc(alloc, (3 * n + nb_buckets + 2) * sizeof(uint32_t));
+    buckets = mem_alloc(alloc, nb_buckets * sizeof(urdflib_bucket_t));
+    if (hashes == NULL || buckets == NULL)
+    {
+        mem_free(alloc, buckets, nb_buckets * sizeof(urdflib_bucket_t));
+        mem_free(alloc, hashes, (3 * n + nb_buckets + 2) * sizeof(uint32_t));
+        return STATUS_MALLOC_ERROR;
+    }
+
+    order = hashes + n;
+    positions = hashes + 2 * n;
+    starts = hashes + 3 * n;
+
+    for (b = 0; b < nb_buckets; b++)
+    {
+        buckets[b].bucket = b;
+        buckets[b].size = 0;
+        displacements[b] = 0;
+    }
+    for (size_t i = 0; i < nb_slots; i++)
+        slots[i] = DICT_EMPTY;
+
+    // keys sorted by bucket (counting sort)
+    for (uint32_t i = 0; i < n; i++)
+    {
+        hashes[i] = hash_bytes(keys + offsets[i], offsets[i + 1] - offsets[i]);
+        buckets[hashes[i] % nb_buckets].size++;
+    }
+
+    starts[0] = 0;
+    for (b = 0; b < nb_buckets; b++)
+        starts[b + 1] = starts[b] + buckets[b].size;
+    for (uint32_t i = 0; i < n; i++)
+        order[starts[hashes[i] % nb_buckets]++] = i;
+    for (b = nb_buckets; b > 0; b--)
+        starts[b] = starts[b - 1];
+    starts[0] = 0;
+
+    qsort(buckets, nb_buckets, sizeof(urdflib_bucket_t), cmp_buckets);
+
+    status = STATUS_OK;
+    for (b = 0; b < nb_buckets && buckets[b].size > 0 && status == STATUS_OK; b++)
+    {
+        start = starts[buckets[b].bucket];
+        size = buckets[b].size;
+
+        // identical keys would collide for any displacement
+        for (uint32_t i = 0; i < size && status == STATUS_OK; i++)
+            for (uint32_t j = 0; j < i && status == STATUS_OK; j++)
+                if (hashes[order[start + i]] == hashes[order[start + j]] &&
+                    is_same_key(keys, offsets, order[start + i], order[start + j]))
+                    status = STATUS_ARG_ERROR;
+
+        is_placed = false;
+        for (d = 0; d < DICT_MAX_DISPLACEMENT && !is_placed && status == STATUS_OK; d++)
+        {
+            is_placed = true;
+            for (k = 0; k < size && is_placed; k++)
+            {
+                positions[k] = hash_displace(hashes[order[start + k]], d) % nb_slots;
+                is_placed = slots[positions[k]] == DICT_EMPTY;
+                for (uint32_t j = 0; j < k && is_placed; j++)
+                    is_placed = positions[j] != positions[k];
+            }
+
+            if (is_placed)
+            {
+                displacements[buckets[b].bucket] = d;
+                for (k = 0; k < size; k++)
+                    slots[positions[k]] = order[start + k];
+            }
+        }
+
+        if (!is_placed && status == STATUS_OK)
+            status = STATUS_ARG_ERROR;
+    }
+
+    mem_free(alloc, buckets, nb_buckets * sizeof(urdflib_bucket_t));
+    mem_free(alloc, hashes, (3 * n + nb_buckets + 2) * sizeof(uint32_t));
+
+    return status;
+}
+
+/**
+ * Find a key in a perfect hash table (a single slot is checked).
+ *
+ * @return the index of the key or DICT_EMPTY if not found
+ */
+uint32_t perfect_hash_find(const urdflib_dict_t *dict, const uint8_t *keys, const uint32_t *offsets,
+                           const uint32_t *displacements, const uint32_t *slots, const uint8_t *key, size_t len)
+{
+    uint32_t h, i;
+
+    if (dict->size == 0)
+        return DICT_EMPTY;
+
+    h = hash_bytes(key, len);
+    i = slots[hash_displace(h, displacements[h % dict->nb_buckets]) % dict->nb_slots];
+
+    if (i == DICT_EMPTY || offsets[i + 1] - offsets[i] != len || memcmp(keys + offsets[i], key, len) != 0)
+        return DICT_EMPTY;
+
+    return i;
+}
+
+/**
+ * Parse an unsigned decimal number of at most max.
+ */
+bool parse_number(const char *b, size_t len, uint64_t max, uint64_t *nb)
+{
+    *nb = 0;
+
+    if (len == 0)
+        return false;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!isdigit((unsigned char)b[i]) || *nb > (max - (b[i] - '0')) / 10)
+            return false;
+        *nb = *nb * 10 + (b[i] - '0');
+    }
+
+    return true;
+}
+
+/**
+ * Parse a line of a vocabulary, encoding its term in buf (of size URDFLIB_TERM_SIZE).
+ *
+ * @return STATUS_OK, STATUS_NO_ITEM if the line is empty or a comment, or STATUS_ARG_ERROR
+ */
+int parse_vocab_line(const char *line, size_t len, const char **iri, size_t *iri_len, urdflib_t *term, uint8_t *buf)
+{
+    size_t i, start, colon;
+    uint64_t id, ns_id;
+
+    for (start = 0; start < len && isspace((unsigned char)line[start]); start++)
+        ;
+    while (len > start && isspace((unsigned char)line[len - 1]))
+        len--;
+
+    if (start == len || line[start] == '#')
+        return STATUS_NO_ITEM;
+
+    // IRI, optionally between angle brackets
+    for (i = start; i < len && !isspace((unsigned char)line[i]); i++)
+        ;
+
+    *iri = line + start;
+    *iri_len = i - start;
+    if (*iri_len >= 2 && (*iri)[0] == '<' && (*iri)[*iri_len - 1] == '>')
+    {
+        (*iri)++;
+        *iri_len -= 2;
+    }
+
+    for (; i < len && isspace((unsigned char)line[i]); i++)
+        ;
+
+    // id or ns_id:local_id
+    for (colon = i; colon < len && line[colon] != ':'; colon++)
+        ;
+
+    if (*iri_len == 0 || i == len)
+        return STATUS_ARG_ERROR;
+
+    if (colon == len)
+    {
+        if (!parse_number(line + i, len - i, URDFLIB_ID_MAX, &id))
+            return STATUS_ARG_ERROR;
+        return urdflib_init_uriref(term, buf, URDFLIB_TERM_SIZE, id);
+    }
+
+    if (!parse_number(line + i, colon - i, URDFLIB_ID_MAX, &ns_id) ||
+        !parse_number(line + colon + 1, len - colon - 1, URDFLIB_ID_MAX, &id))
+        return STATUS_ARG_ERROR;
+
+    return urdflib_init_uriref_curie(term, buf, URDFLIB_TERM_SIZE, ns_id, id);
+}
+
+/**
+ * Read all lines of a vocabulary, counting entries and bytes
+ * or, if dict has storage, copying IRIs and terms into it.
+ */
+int read_vocab(urdflib_dict_t *dict, const char *text, size_t len, size_t *iris_size, size_t *terms_size)
+{
+    int status;
+    size_t start, end, iri_len, n;
+    const char *iri;
+    uint8_t buf[URDFLIB_TERM_SIZE];
+    urdflib_t term;
+    char *iris = (char *)dict->iris;
+    uint8_t *terms = (uint8_t *)dict->terms;
+    uint32_t *iri_offsets = (uint32_t *)dict->iri_offsets;
+    uint32_t *term_offsets = (uint32_t *)dict->term_offsets;
+
+    n = 0;
+    *iris_size = 0;
+    *terms_size = 0;
+
+    for (start = 0; start < len; start = end + 1)
+    {
+        for (end = start; end < len && text[end] != '\n'; end++)
+            ;
+
+        status = parse_vocab_line(text + start, end - start, &iri, &iri_len, &term, buf);
+        if (status == STATUS_NO_ITEM)
+            continue;
+        if (status < STATUS_OK)
+            return STATUS_ARG_ERROR;
+
+        if (dict->storage != NULL)
+        {
+            iri_offsets[n] = *iris_size;
+            term_offsets[n] = *terms_size;
+            memcpy(iris + *iris_size, iri, iri_len);
+            memcpy(terms + *terms_size, term.buffer, term.size);
+        }
+
+        n++;
+        *iris_size += iri_len;
+        *terms_size += term.size;
+
+        if (*iris_size > UINT32_MAX || n >= DICT_EMPTY)
+            return STATUS_ARG_ERROR;
+    }
+
+    if (dict->storage != NULL)
+    {
+        iri_offsets[n] = *iris_size;
+        term_offsets[n] = *terms_size;
+    }
+
+    dict->size = n;
+
+    return STATUS_OK;
+}
+
+int urdflib_dict_parse(urdflib_dict_t *dict, const char *text, size_t len)
+{
+    int status;
+    size_t n, iris_size, terms_size, nb_u32;
+    uint32_t *u32;
+
+    memset(dict, 0, sizeof(urdflib_dict_t));
+    dict->alloc = default_allocator;
+
+    // count entries and bytes, then copy them
+    status = read_vocab(dict, text, len, &iris_size, &terms_size);
+    if (status < STATUS_OK)
+        return status;
+
+    n = dict->size;
+    dict->nb_buckets = n / DICT_BUCKET_SIZE + 1;
+    dict->nb_slots = n + n / 4 + 1;
+
+    // offsets, displacements and slots of both tables, then IRIs and terms
+    nb_u32 = 2 * (n + 1) + 2 * dict->nb_buckets + 2 * dict->nb_slots;
+    dict->storage_size = nb_u32 * sizeof(uint32_t) + iris_size + terms_size;
+    dict->storage = mem_alloc(dict->alloc, dict->storage_size);
+    if (dict->storage == NULL)
+        return STATUS_MALLOC_ERROR;
+
+    u32 = dict->storage;
+    dict->iri_offsets = u32;
+    dict->term_offsets = u32 + n + 1;
+    dict->iri_displacements = u32 + 2 * (n + 1);
+    dict->term_displacements = dict->iri_displacements + dict->nb_buckets;
+    dict->iri_slots = dict->term_displacements + dict->nb_buckets;
+    dict->term_slots = dict->iri_slots + dict->nb_slots;
+    dict->iris = (const char *)(u32 + nb_u32);
+    dict->terms = (const uint8_t *)dict->iris + iris_size;
+
+    status = read_vocab(dict, text, len, &iris_size, &terms_size);
+
+    if (status == STATUS_OK)
+        status = perfect_hash_build(dict->alloc, n, (const uint8_t *)dict->iris, dict->iri_offsets,
+                                    dict->nb_buckets, dict->nb_slots,
+                                    (uint32_t *)dict->iri_displacements, (uint32_t *)dict->iri_slots);
+    if (status == STATUS_OK)
+        status = perfect_hash_build(dict->alloc, n, dict->terms, dict->term_offsets,
+                                    dict->nb_buckets, dict->nb_slots,
+                                    (uint32_t *)dict->term_displacements, (uint32_t *)dict->term_slots);
+
+    if (status < STATUS_OK)
+        urdflib_dict_delete(dict);
+
+    return status;
+}
+
+void urdflib_dict_delete(urdflib_dict_t *dict)
+{
+    if (dict->storage != NULL)
+        mem_free(dict->alloc, dict->storage, dict->storage_size);
+
+    memset(dict, 0, sizeof(urdflib_dict_t));
+}
+
+int urdflib_dict_find_term(const urdflib_dict_t *dict, const char *iri, size_t len, urdflib_t *term)
+{
+    uint32_t i;
+
+    i = perfect_hash_find(dict, (const uint8_t *)dict->iris, dict->iri_offsets,
+                          dict->iri_displacements, dict->iri_slots, (const uint8_t *)iri, len);
+    if (i == DICT_EMPTY)
+        return STATUS_NO_ITEM;
+
+    size_t size = dict->term_offsets[i + 1] - dict->term_offsets[i];
+    return init_term(term, (uint8_t *)dict->terms + dict->term_offsets[i], size, TYPE_URIREF, size);
+}
+
+int urdflib_dict_find_iri(const urdflib_dict_t *dict, const urdflib_t *term, const char **iri, size_t *len)
+{
+    uint32_t i;
+
+    if (!is_uriref(term))
+        return STATUS_ARG_ERROR;
+
+    i = perfect_hash_find(dict, dict->terms, dict->term_offsets,
+                          dict->term_displacements, dict->term_slots, term->buffer, term->size);
+    if (i == DICT_EMPTY)
+        return STATUS_NO_ITEM;
+
+    *iri = dict->iris + dict->iri_offsets[i];
+    *len = dict->iri_offsets[i + 1] - dict->iri_offsets[i];
+
+    return STATUS_OK;
+}
+
+#ifndef URDFLIB_NO_FILES
+
+int urdflib_dict_load(urdflib_dict_t *dict, const char *path)
+{
+    int status;
+    long len;
+    char *text;
+    FILE *fp;
+
+    memset(dict, 0, sizeof(urdflib_dict_t));
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+        return STATUS_IO_ERROR;
+
+    if (fseek(fp, 0, SEEK_END) < 0 || (len = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) < 0)
+    {
+        fclose(fp);
+        return STATUS_IO_ERROR;
+    }
+
+    text = mem_alloc(default_allocator, len + 1);
+    if (text == NULL)
+    {
+        fclose(fp);
+        return STATUS_MALLOC_ERROR;
+    }
+
+    if (fread(text, 1, len, fp) == (size_t)len)
+        status = urdflib_dict_parse(dict, text, len);
+    else
+        status = STATUS_IO_ERROR;
+
+    mem_free(default_allocator, text, len + 1);
+    fclose(fp);
+
+    return status;
+}
+
+/**
+ * Write an array of n values as C source.
+ */
+void write_c_array(FILE *fp, const char *type, const char *name, const char *suffix, const void *values, size_t n, size_t width)
+{
+    fprintf(fp, "static const %s %s_%s[%zu] = {", type, name, suffix, n > 0 ? n : 1);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i % 12 == 0)
+            fprintf(fp, "\n   ");
+        if (width == 1)
+            fprintf(fp, " %u,", ((const uint8_t *)values)[i]);
+        else
+            fprintf(fp, " %lu,", (unsigned long)((const uint32_t *)values)[i]);
+    }
+
+    fprintf(fp, "%s};\n\n", n > 0 ? "\n" : "0");
+}
+
+int urdflib_dict_write_c(const urdflib_dict_t *dict, const char *path, const char *name)
+{
+    FILE *fp;
+    size_t n = dict->size;
+
+    fp = fopen(path, "w");
+    if (fp == NULL)
+        return STATUS_IO_ERROR;
+
+    fprintf(fp, "// Generated by uRDFLib (see urdflib_dict_write_c), do not edit.\n");
+    fprintf(fp, "#include <stddef.h>\n#include <urdflib.h>\n\n");
+
+    write_c_array(fp, "char", name, "iris", dict->iris, dict->iri_offsets[n], 1);
+    write_c_array(fp, "uint32_t", name, "iri_offsets", dict->iri_offsets, n + 1, 4);
+    write_c_array(fp, "uint8_t", name, "terms", dict->terms, dict->term_offsets[n], 1);
+    write_c_array(fp, "uint32_t", name, "term_offsets", dict->term_offsets, n + 1, 4);
+    write_c_array(fp, "uint32_t", name, "iri_displacements", dict->iri_displacements, dict->nb_buckets, 4);
+    write_c_array(fp, "uint32_t", name, "iri_slots", dict->iri_slots, dict->nb_slots, 4);
+    write_c_array(fp, "uint32_t", name, "term_displacements", dict->term_displacements, dict->nb_buckets, 4);
+    write_c_array(fp, "uint32_t", name, "term_slots", dict->term_slots, dict->nb_slots, 4);
+
+    fprintf(fp, "const urdflib_dict_t %s = {\n", name);
+    fprintf(fp, "    .size = %zu,\n    .nb_buckets = %zu,\n    .nb_slots = %zu,\n", n, dict->nb_buckets, dict->nb_slots);
+    fprintf(fp, "    .iris = %s_iris,\n    .iri_offsets = %s_iri_offsets,\n", name, name);
+    fprintf(fp, "    .terms = %s_terms,\n    .term_offsets = %s_term_offsets,\n", name, name);
+    fprintf(fp, "    .iri_displacements = %s_iri_displacements,\n    .iri_slots = %s_iri_slots,\n", name, name);
+    fprintf(fp, "    .term_displacements = %s_term_displacements,\n    .term_slots = %s_term_slots};\n", name, name);
+
+    return fclose(fp) == 0 ? STATUS_OK : STATUS_IO_ERROR;
+}
+
+#endif
+
+/*******************************************************************************
+ * Functions to scan graphs in parallel.
+ ******************************************************************************/
+
+/**
+ * Number of ranges per thread in a parallel scan:
+ * threads done early take the ranges left by slower ones.
+ */
+#define RANGES_PER_THREAD 8
+
+/**
+ * Record a node at offset as the boundary of the ranges whose target it follows,
+ * if closer to the target than the node found so far (see urdflib_split_graph).
+ */
+void range_boundary(urdflib_range_t *ranges, size_t n, size_t offset)
+{
+    size_t lo, hi, mid;
+
+    // last target at or before offset
+    lo = 0;
+    hi = n;
+    while (hi - lo > 1)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (ranges[mid].start <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    if (offset < ranges[lo].end)
+        ranges[lo].end = offset;
+}
+
+/**
+ * Skip the node starting at idx in graph g by reading CBOR heads only:
+ * terms are not decoded, strings are skipped by length
+ * and indefinite-length items are matched with their break.
+ */
+int skip_node(const urdflib_t *g, size_t *idx)
+{
+    const uint8_t *b;
+    uint8_t major, info;
+    size_t depth, len;
+    uint64_t value;
+
+    if (*idx >= g->size || g->buffer[*idx] != 0xBF)
+        return STATUS_BUFFER_ERROR;
+
+    depth = 0;
+    do
+    {
+        if (*idx >= g->size)
+            return STATUS_CBOR_ERROR;
+
+        b = g->buffer + *idx;
+        if (b[0] == 0xFF)
+        {
+            (*idx)++;
+            depth--;
+            continue;
+        }
+
+        major = b[0] >> 5;
+        info = b[0] & 0x1F;
+        if (ARG_SIZES[info] == ARG_INVALID || g->size - *idx <= ARG_SIZES[info])
+            return STATUS_CBOR_ERROR;
+
+        len = 1 + ARG_SIZES[info];
+        if (info == 31)
+            depth++;
+        else if (major == 2 || major == 3)
+        {
+            value = head_value(b);
+            if (value > g->size - *idx - len)
+                return STATUS_CBOR_ERROR;
+            len += value;
+        }
+
+        *idx += len;
+    } while (depth > 0);
+
+    return STATUS_OK;
+}
+
+int urdflib_split_graph(const urdflib_t *g, urdflib_range_t *ranges, size_t n)
+{
+    int status;
+    size_t start, end, dir, idx, offset, count, entry_size, i, k;
+    uint8_t width;
+    const uint8_t *entries;
+
+    if (!is_graph(g) || n == 0)
+        return STATUS_ARG_ERROR;
+
+    start = 0;
+    status = decode_graph_start(g, &start, NULL);
+    if (status < STATUS_OK)
+        return status;
+
+    // { @graph: [ ... ] } (followed by its directory, if any)
+    dir = directory_start(g);
+    end = (dir > 0 ? dir : g->size) - 2;
+    if (end < start)
+        return STATUS_BUFFER_ERROR;
+
+    // until boundaries are set, start is the target offset of a range
+    // and end the offset of the first node found at or after it
+    for (k = 0; k < n; k++)
+    {
+        ranges[k].start = start + (end - start) * k / n;
+        ranges[k].end = end;
+    }
+    ranges[0].end = start;
+
+    if (dir > 0)
+    {
+        width = directory_width(g, dir);
+        entry_size = DIRECTORY_ENTRY_SIZE(width);
+        entries = g->buffer + dir + DIRECTORY_HEAD_SIZE(width);
+        count = load_uint(g->buffer + dir + 5, width) / entry_size;
+
+        for (i = 0; i < count; i++)
+            range_boundary(ranges, n, load_uint(entries + i * entry_size + 4, width));
+    }
+    else if (g->index != NULL)
+    {
+        for (i = 0; i < g->index->capacity; i++)
+            if (g->index->slots[i].offset > 0)
+                range_boundary(ranges, n, g->index->slots[i].offset);
+    }
+    else
+    {
+        // nodes are found in order: the pre-pass ends at the last target
+        idx = start;
+        while (idx < ranges[n - 1].end)
+        {
+            offset = idx;
+            status = skip_node(g, &idx);
+            if (status < STATUS_OK)
+                return status;
+
+            range_boundary(ranges, n, offset);
+        }
+    }
+
+    // a node found after a target is the boundary of previous targets not reached yet
+    for (k = n - 1; k-- > 0;)
+        if (ranges[k + 1].end < ranges[k].end)
+            ranges[k].end = ranges[k + 1].end;
+
+    // [ boundary k, boundary k + 1 ), empty ranges being dropped
+    i = 0;
+    for (k = 0; k < n; k++)
+    {
+        offset = ranges[k].end;
+        idx = k + 1 < n ? ranges[k + 1].end : end;
+
+        if (offset < idx)
+        {
+            ranges[i].start = offset;
+            ranges[i].end = idx;
+            i++;
+        }
+    }
+
+    return i;
+}
+
+#ifndef URDFLIB_NO_THREADS
+
+/**
+ * Parallel scan shared by all threads.
+ */
+typedef struct
+{
+    const urdflib_t *g;
+    const urdflib_t *p;
+    const urdflib_t *o;
+    urdflib_triple_callback_t callback;
+    const urdflib_range_t *ranges;
+    size_t nb_ranges;
+    atomic_size_t next_range; // first range not taken by a thread yet
+    atomic_int status;        // first error (STATUS_OK if none)
+} urdflib_scan_t;
+
+/**
+ * Thread of a parallel scan, with the state passed to the callback.
+ */
+typedef struct
+{
+    urdflib_scan_t *scan;
+    void *state;
+    pthread_t thread;
+} urdflib_worker_t;
+
+/**
+ * Call the callback of scan for each triple matching in a range of nodes.
+ */
+int scan_range(const urdflib_scan_t *scan, const urdflib_range_t *range, void *state)
+{
+    int status;
+    urdflib_ctx_t ctx;
+    urdflib_t view, s, p, o;
+
+    // the graph seen up to the end of the range
+    view = *scan->g;
+    view.size = range->end;
+
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    ctx.idx = range->start;
+
+    while ((status = find_triples(&view, &ctx, NULL, NULL, scan->p, scan->o, &s, &p, &o)) == STATUS_OK)
+    {
+        status = scan->callback(state, &s, &p, &o);
+        if (status < STATUS_OK)
+            return status;
+    }
+
+    return status == STATUS_NO_ITEM ? STATUS_OK : status;
+}
+
+void *scan_worker(void *arg)
+{
+    urdflib_worker_t *worker = arg;
+    urdflib_scan_t *scan = worker->scan;
+    size_t i;
+    int status, expected;
+
+    while (atomic_load(&scan->status) == STATUS_OK)
+    {
+        i = atomic_fetch_add(&scan->next_range, 1);
+        if (i >= scan->nb_ranges)
+            break;
+
+        status = scan_range(scan, &scan->ranges[i], worker->state);
+
+        // other threads stop after their current range
+        expected = STATUS_OK;
+        if (status < STATUS_OK)
+            atomic_compare_exchange_strong(&scan->status, &expected, status);
+    }
+
+    return NULL;
+}
+
+int urdflib_scan_parallel(const urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o,
+                          urdflib_triple_callback_t callback, void *const *states, size_t nb_threads)
+{
+    int status;
+    size_t n, nb_started;
+    urdflib_ctx_t ctx;
+    urdflib_t s_out, p_out, o_out;
+    urdflib_scan_t scan;
+    urdflib_range_t *ranges;
+    urdflib_worker_t *workers;
+    const urdflib_allocator_t *alloc;
+
+    if (!is_graph(g) || callback == NULL || nb_threads == 0)
+        return STATUS_ARG_ERROR;
+
+    // a subject has a single node
+    if (s != NULL)
+    {
+        memset(&ctx, 0, sizeof(urdflib_ctx_t));
+        while ((status = find_triples(g, &ctx, g->index, s, p, o, &s_out, &p_out, &o_out)) == STATUS_OK)
+        {
+            status = callback(states != NULL ? states[0] : NULL, &s_out, &p_out, &o_out);
+            if (status < STATUS_OK)
+                return status;
+        }
+
+        return status == STATUS_NO_ITEM ? STATUS_OK : status;
+    }
+
+    alloc = g->alloc != NULL ? g->alloc : default_allocator;
+    n = nb_threads * RANGES_PER_THREAD;
+    ranges = mem_alloc(alloc, n * sizeof(urdflib_range_t));
+    workers = mem_alloc(alloc, nb_threads * sizeof(urdflib_worker_t));
+    if (ranges == NULL || workers == NULL)
+    {
+        mem_free(alloc, workers, nb_threads * sizeof(urdflib_worker_t));
+        mem_free(alloc, ranges, n * sizeof(urdflib_range_t));
+        return STATUS_MALLOC_ERROR;
+    }
+
+    status = urdflib_split_graph(g, ranges, n);
+
+    if (status >= STATUS_OK)
+    {
+        scan.g = g;
+        scan.p = p;
+        scan.o = o;
+        scan.callback = callback;
+        scan.ranges = ranges;
+        scan.nb_ranges = status;
+        atomic_init(&scan.next_range, 0);
+        atomic_init(&scan.status, STATUS_OK);
+
+        for (size_t i = 0; i < nb_threads; i++)
+        {
+            workers[i].scan = &scan;
+            workers[i].state = states != NULL ? states[i] : NULL;
+        }
+
+        // ranges left by threads that could not be started are taken by the others
+        for (nb_started = 1; nb_started < nb_threads && nb_started < scan.nb_ranges; nb_started++)
+            if (pthread_create(&workers[nb_started].thread, NULL, scan_worker, &workers[nb_started]) != 0)
+                break;
+
+        scan_worker(&workers[0]);
+
+        for (size_t i = 1; i < nb_started; i++)
+            pthread_join(workers[i].thread, NULL);
+
+        status = atomic_load(&scan.status);
+    }
+
+    mem_free(alloc, workers, nb_threads * sizeof(urdflib_worker_t));
+    mem_free(alloc, ranges, n * sizeof(urdflib_range_t));
+
+    return status;
+}
+
+static int count_triple(void *state, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o)
+{
+    (void)s;
+    (void)p;
+    (void)o;
+
+    (*(size_t *)state)++;
+
+    return STATUS_OK;
+}
+
+int urdflib_count_triples(const urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o,
+                          size_t nb_threads, size_t *count)
+{
+    int status;
+    size_t *counts;
+    void **states;
+    const urdflib_allocator_t *alloc;
+
+    *count = 0;
+
+    if (nb_threads == 0)
+        return STATUS_ARG_ERROR;
+
+    alloc = g->alloc != NULL ? g->alloc : default_allocator;
+    counts = mem_calloc(alloc, nb_threads, sizeof(size_t));
+    states = mem_alloc(alloc, nb_threads * sizeof(void *));
+
+    status = counts != NULL && states != NULL ? STATUS_OK : STATUS_MALLOC_ERROR;
+
+    for (size_t i = 0; status == STATUS_OK && i < nb_threads; i++)
+        states[i] = &counts[i];
+
+    if (status == STATUS_OK)
+        status = urdflib_scan_parallel(g, s, p, o, count_triple, states, nb_threads);
+
+    // per-thread counts merged once all threads are done
+    for (size_t i = 0; status == STATUS_OK && i < nb_threads; i++)
+        *count += counts[i];
+
+    mem_free(alloc, states, nb_threads * sizeof(void *));
+    mem_free(alloc, counts, nb_threads * sizeof(size_t));
+
+    return status;
+}
+
+#endif
+
+/*******************************************************************************
+ * Functions to traverse graphs through tapes.
+ ******************************************************************************/
+
+/**
+ * Types of tape entries other than terms (whose type is a TYPE_*).
+ */
+#define TAPE_NODE 0x10
+#define TAPE_PAIR 0x11
+
+/**
+ * Entry of a tape: a node, a pair or a term of the graph.
+ */
+struct urdflib_tape_entry
+{
+    size_t offset; // offset in the graph
+    uint32_t size; // term: size of its encoding, node or pair: number of entries it spans
+    uint8_t type;
+};
+
+int tape_push(urdflib_tape_t *tape, uint8_t type, size_t offset, size_t size)
+{
+    int status;
+    struct urdflib_tape_entry *entry;
+
+    if (size > UINT32_MAX)
+        return STATUS_BUFFER_ERROR;
+
+    status = grow_array(tape->g.alloc, (void **)&tape->entries, &tape->capacity,
+                        tape->size + 1, sizeof(struct urdflib_tape_entry));
+    if (status < STATUS_OK)
+        return status;
+
+    entry = &tape->entries[tape->size++];
+    entry->offset = offset;
+    entry->size = size;
+    entry->type = type;
+
+    return STATUS_OK;
+}
+
+int tape_push_term(urdflib_tape_t *tape, const urdflib_t *x)
+{
+    return tape_push(tape, x->type, x->buffer - tape->g.buffer, x->size);
+}
+
+/**
+ * Point x to the term of entry i of a tape.
+ */
+void tape_term(const urdflib_tape_t *tape, size_t i, urdflib_t *x)
+{
+    x->buffer = tape->g.buffer + tape->entries[i].offset;
+    x->size = tape->entries[i].size;
+    x->type = tape->entries[i].type;
+}
+
+/**
+ * Append the entries of the node starting at idx to a tape.
+ */
+int tape_node(urdflib_tape_t *tape, size_t *idx)
+{
+    int status;
+    size_t node, pair, node_idx;
+    bool has_single_value;
+    urdflib_t id, key, val;
+    const urdflib_t *g = &tape->g;
+
+    // { @id: s, ... }
+    node_idx = *idx;
+    status = decode_node_start(g, idx, &id);
+    if (status != STATUS_OK)
+        return status;
+
+    node = tape->size;
+    status = tape_push(tape, TAPE_NODE, node_idx, 0);
+    if (status < STATUS_OK)
+        return status;
+
+    status = tape_push_term(tape, &id);
+    if (status == STATUS_OK)
+        status = index_insert(tape->subjects, hash_buffer(&id), node + 1);
+
+    while (status == STATUS_OK && (status = decode_key(g, idx, &key)) == STATUS_OK)
+    {
+        // { ..., p: [ ... ] }
+        pair = tape->size;
+        status = tape_push(tape, TAPE_PAIR, key.buffer - g->buffer, 0);
+        if (status == STATUS_OK)
+            status = tape_push_term(tape, &key);
+        if (status < STATUS_OK)
+            break;
+
+        decode_values_start(g, idx, &has_single_value);
+
+        while (status == STATUS_OK && (status = decode_value(g, idx, &val)) == STATUS_OK)
+        {
+            status = tape_push_term(tape, &val);
+            if (has_single_value)
+                break;
+        }
+
+        if (status == STATUS_NO_ITEM && !has_single_value)
+            status = decode_values_end(g, idx);
+        if (status < STATUS_OK)
+            break;
+
+        // values all removed (see urdflib_remove_triples)
+        if (tape->size == pair + 2)
+            tape->size = pair;
+        else
+            tape->entries[pair].size = tape->size - pair;
+    }
+
+    if (status == STATUS_NO_ITEM)
+        status = decode_node_end(g, idx);
+
+    tape->entries[node].size = tape->size - node;
+
+    return status;
+}
+
+int urdflib_tape_build(const urdflib_t *g, urdflib_tape_t *tape)
+{
+    int status;
     size_t idx;
-    urdflib_t uriref;
 
-    uriref.buffer = buf;
-    uriref.size = 20;
-    uriref.type = TYPE_URIREF;
+    memset(tape, 0, sizeof(urdflib_tape_t));
+
+    if (!is_graph(g))
+        return STATUS_ARG_ERROR;
+
+    // read-only view of g
+    init_term(&tape->g, g->buffer, g->size, TYPE_GRAPH, g->size);
+    tape->g.alloc = g->alloc != NULL ? g->alloc : default_allocator;
+
+    tape->subjects = index_new(tape->g.alloc);
+    if (tape->subjects == NULL)
+        return STATUS_MALLOC_ERROR;
+
+    idx = 0;
+    status = decode_graph_start(&tape->g, &idx, NULL);
+
+    while (status == STATUS_OK)
+        status = tape_node(tape, &idx);
+
+    if (status != STATUS_NO_ITEM)
+    {
+        urdflib_tape_delete(tape);
+        return status;
+    }
+
+    return STATUS_OK;
+}
+
+void urdflib_tape_delete(urdflib_tape_t *tape)
+{
+    if (tape->g.alloc != NULL)
+        mem_free(tape->g.alloc, tape->entries, tape->capacity * sizeof(struct urdflib_tape_entry));
+
+    index_free(tape->subjects);
+    memset(tape, 0, sizeof(urdflib_tape_t));
+}
+
+/**
+ * Return the index of the node entry of subject s in a tape + 1, or 0 if not found.
+ */
+size_t tape_find_node(const urdflib_tape_t *tape, const urdflib_t *s)
+{
+    uint32_t hash;
+    size_t i, entry;
+
+    hash = hash_buffer(s);
+
+    i = hash & (tape->subjects->capacity - 1);
+    while ((entry = tape->subjects->slots[i].offset) > 0)
+    {
+        // entry of the subject, following the node entry
+        if (tape->subjects->slots[i].hash == hash && tape->entries[entry].size == s->size &&
+            memcmp(tape->g.buffer + tape->entries[entry].offset, s->buffer, s->size) == 0)
+            return entry;
+
+        i = (i + 1) & (tape->subjects->capacity - 1);
+    }
+
+    return 0;
+}
+
+/**
+ * Find the next triple matching s, p and o in a tape.
+ * The context holds the next entry to read (idx)
+ * and the entries of the current subject (node_idx) and key (key_idx).
+ */
+int tape_find_triples(const urdflib_tape_t *tape, urdflib_ctx_t *ctx,
+                      const urdflib_t *s, const urdflib_t *p, const urdflib_t *o,
+                      urdflib_t *s_out, urdflib_t *p_out, urdflib_t *o_out)
+{
+    size_t node;
+    urdflib_t key, val;
+    const struct urdflib_tape_entry *entry;
+
+    if (ctx->idx == 0 && ctx->node_idx == 0 && s != NULL)
+    {
+        node = tape_find_node(tape, s);
+
+        // subject not in g
+        ctx->idx = node > 0 ? node - 1 : tape->size;
+    }
+
+    while (ctx->idx < tape->size)
+    {
+        entry = &tape->entries[ctx->idx];
+
+        if (entry->type == TAPE_NODE)
+        {
+            // a subject has a single node
+            if (s != NULL && ctx->node_idx > 0)
+                break;
+
+            ctx->node_idx = ctx->idx + 1;
+            ctx->idx += 2;
+        }
+        else if (entry->type == TAPE_PAIR)
+        {
+            tape_term(tape, ctx->idx + 1, &key);
+
+            if (p != NULL && urdflib_cmp(p, &key) != 0)
+            {
+                STATS_ADD(pairs_skipped, 1);
+                ctx->idx += entry->size;
+                continue;
+            }
+
+            ctx->key_idx = ctx->idx + 1;
+            ctx->idx += 2;
+        }
+        else
+        {
+            tape_term(tape, ctx->idx++, &val);
+
+            if (o != NULL && urdflib_cmp(o, &val) != 0)
+                continue;
+
+            if (s_out != NULL)
+                tape_term(tape, ctx->node_idx, s_out);
+            if (p_out != NULL)
+                tape_term(tape, ctx->key_idx, p_out);
+            if (o_out != NULL)
+                *o_out = val;
+
+            return STATUS_OK;
+        }
+    }
+
+    ctx->idx = tape->size;
+
+    return STATUS_NO_ITEM;
+}
+
+int urdflib_tape_find_triples(const urdflib_tape_t *tape, urdflib_ctx_t *ctx,
+                              const urdflib_t *s, const urdflib_t *p, const urdflib_t *o,
+                              urdflib_t *s_out, urdflib_t *p_out, urdflib_t *o_out)
+{
+    STATS_ADD(find_triples_calls, 1);
+
+    if (tape->subjects == NULL)
+        return STATUS_ARG_ERROR;
+
+    return tape_find_triples(tape, ctx, s, p, o, s_out, p_out, o_out);
+}
+
+/*******************************************************************************
+ * Functions to evaluate graph patterns.
+ ******************************************************************************/
+
+/**
+ * Marker for terms of a triple pattern that are not variables.
+ */
+#define NOT_A_VARIABLE URDFLIB_ID_MAX
+
+/**
+ * State of the evaluation of a graph pattern (basic graph pattern)
+ * with backtracking: one cursor per triple pattern, in join order.
+ */
+struct urdflib_state
+{
+    size_t nb_patterns;
+    size_t nb_vars;      // number of distinct variables (one slot each)
+    size_t mapping_size; // largest variable index + 1
+    size_t level;  // index of the triple pattern being matched
+    bool is_started;
+    const urdflib_allocator_t *alloc;
+    const urdflib_tape_t *tape;     // tape of g, if triple patterns are matched on it
+    struct urdflib_index *subjects; // subject index built for the evaluation (if g has none)
+    urdflib_t (*patterns)[3];       // triple patterns, in join order
+    urdflib_id_t (*vars)[3];        // variable slot of each term of triple patterns
+    urdflib_id_t *var_ids;          // variable index of each slot, in increasing order
+    urdflib_ctx_t *cursors;         // position of each triple pattern in g
+    urdflib_t *bindings;            // term bound to each slot
+    size_t *bound_at;               // level + 1 at which each slot was bound (0 if unbound)
+};
+
+/**
+ * Return the index of variable var (not truncated to urdflib_id_t).
+ */
+uint64_t variable_index(const urdflib_t *var)
+{
+    size_t idx;
+    urdflib_token_t token;
+
+    // 2019(var_idx)
+    idx = 0;
+    decode_token(var, &idx, &token);
+    decode_token(var, &idx, &token);
+
+    return token.value;
+}
+
+void state_delete(struct urdflib_state *state)
+{
+    const urdflib_allocator_t *alloc = state->alloc;
+    size_t n = state->nb_patterns;
+
+    index_free(state->subjects);
+    mem_free(alloc, state->patterns, n * sizeof(urdflib_t[3]));
+    mem_free(alloc, state->vars, n * sizeof(urdflib_id_t[3]));
+    mem_free(alloc, state->var_ids, state->nb_vars * sizeof(urdflib_id_t));
+    mem_free(alloc, state->cursors, n * sizeof(urdflib_ctx_t));
+    mem_free(alloc, state->bindings, state->nb_vars * sizeof(urdflib_t));
+    mem_free(alloc, state->bound_at, state->nb_vars * sizeof(size_t));
+    mem_free(alloc, state, sizeof(struct urdflib_state));
+}
+
+int cmp_ids(const void *x, const void *y)
+{
+    urdflib_id_t a = *(const urdflib_id_t *)x;
+    urdflib_id_t b = *(const urdflib_id_t *)y;
+
+    return a < b ? -1 : a > b;
+}
+
+/**
+ * Return the slot of variable var among the sorted variable indexes of state.
+ */
+urdflib_id_t variable_slot(const struct urdflib_state *state, const urdflib_t *var)
+{
+    urdflib_id_t var_idx = variable_index(var);
+    const urdflib_id_t *id = bsearch(&var_idx, state->var_ids, state->nb_vars, sizeof(urdflib_id_t), cmp_ids);
+
+    return id - state->var_ids;
+}
+
+/**
+ * Estimate how selective a triple pattern with variable slots vars is,
+ * given already bound variables:
+ * a bound subject restricts matching to a single node,
+ * a bound object or predicate filters triples of scanned nodes.
+ */
+int selectivity(const urdflib_id_t *vars, const bool *is_bound)
+{
+    int score = 0;
+
+    if (vars[0] == NOT_A_VARIABLE || is_bound[vars[0]])
+        score += 4;
+    if (vars[2] == NOT_A_VARIABLE || is_bound[vars[2]])
+        score += 2;
+    if (vars[1] == NOT_A_VARIABLE || is_bound[vars[1]])
+        score += 1;
+
+    return score;
+}
+
+/**
+ * Read triple patterns of q and order them by selectivity (greedily).
+ * Variables are given dense slots, so that the state does not grow
+ * with the largest variable index.
+ */
+int state_create(const urdflib_t *g, const urdflib_t *q, struct urdflib_state **out)
+{
+    int status;
+    size_t n, i, j, k, best, nb_ids;
+    int score, best_score;
+    urdflib_ctx_t ctx = {0};
+    urdflib_t t[3];
+    struct urdflib_state *state;
+    urdflib_t (*patterns)[3];
+    urdflib_id_t (*vars)[3];
+    urdflib_id_t *ids;
+    bool *is_bound;
+    const urdflib_allocator_t *alloc;
+
+    alloc = g->alloc != NULL ? g->alloc : default_allocator;
+
+    state = mem_calloc(alloc, 1, sizeof(struct urdflib_state));
+    if (state == NULL)
+        return STATUS_MALLOC_ERROR;
+
+    state->alloc = alloc;
+
+    // count triple patterns and occurrences of variables
+    // (URDFLIB_ID_MAX and above are no variable indexes)
+    nb_ids = 0;
+    while ((status = find_next_triple(q, &ctx, &t[0], &t[1], &t[2])) == STATUS_OK)
+    {
+        state->nb_patterns++;
+        for (j = 0; j < 3; j++)
+            if (is_variable(&t[j]) && variable_index(&t[j]) >= NOT_A_VARIABLE)
+                status = STATUS_ARG_ERROR;
+            else if (is_variable(&t[j]))
+                nb_ids++;
+        if (status != STATUS_OK)
+            break;
+    }
+
+    if (status != STATUS_NO_ITEM)
+    {
+        mem_free(alloc, state, sizeof(struct urdflib_state));
+        return status;
+    }
+
+    n = state->nb_patterns;
+    patterns = mem_alloc(alloc, n * sizeof(urdflib_t[3]) + 1);
+    vars = mem_alloc(alloc, n * sizeof(urdflib_id_t[3]) + 1);
+    ids = mem_alloc(alloc, nb_ids * sizeof(urdflib_id_t) + 1);
+    state->patterns = mem_alloc(alloc, n * sizeof(urdflib_t[3]));
+    state->vars = mem_alloc(alloc, n * sizeof(urdflib_id_t[3]));
+    state->cursors = mem_calloc(alloc, n, sizeof(urdflib_ctx_t));
+
+    status = STATUS_OK;
+    if (patterns == NULL || vars == NULL || ids == NULL ||
+        (n > 0 && (state->patterns == NULL || state->vars == NULL || state->cursors == NULL)))
+        status = STATUS_MALLOC_ERROR;
+
+    // read triple patterns in document order
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    k = 0;
+    for (i = 0; status == STATUS_OK && i < n; i++)
+    {
+        find_next_triple(q, &ctx, &patterns[i][0], &patterns[i][1], &patterns[i][2]);
+        for (j = 0; j < 3; j++)
+            if (is_variable(&patterns[i][j]))
+                ids[k++] = variable_index(&patterns[i][j]);
+    }
+
+    // one slot per distinct variable, in increasing order of index
+    if (status == STATUS_OK)
+    {
+        qsort(ids, nb_ids, sizeof(urdflib_id_t), cmp_ids);
+        for (i = 0; i < nb_ids; i++)
+            if (state->nb_vars == 0 || ids[state->nb_vars - 1] != ids[i])
+                ids[state->nb_vars++] = ids[i];
+
+        state->mapping_size = state->nb_vars > 0 ? (size_t)ids[state->nb_vars - 1] + 1 : 0;
+        state->var_ids = mem_alloc(alloc, state->nb_vars * sizeof(urdflib_id_t));
+        state->bindings = mem_calloc(alloc, state->nb_vars, sizeof(urdflib_t));
+        state->bound_at = mem_calloc(alloc, state->nb_vars, sizeof(size_t));
+
+        if (state->nb_vars > 0 && (state->var_ids == NULL || state->bindings == NULL || state->bound_at == NULL))
+            status = STATUS_MALLOC_ERROR;
+        else if (state->nb_vars > 0)
+            memcpy(state->var_ids, ids, state->nb_vars * sizeof(urdflib_id_t));
+    }
+
+    is_bound = mem_calloc(alloc, state->nb_vars + 1, sizeof(bool));
+    if (is_bound == NULL)
+        status = STATUS_MALLOC_ERROR;
 
-    idx = 0;
-    encode_uriref_curie(&uriref, &idx, ns_id, local_id);
+    for (i = 0; status == STATUS_OK && i < n; i++)
+        for (j = 0; j < 3; j++)
+            vars[i][j] = is_variable(&patterns[i][j]) ? variable_slot(state, &patterns[i][j]) : NOT_A_VARIABLE;
 
-    uriref.buffer = malloc(idx);
-    memcpy(uriref.buffer, buf, idx);
-    uriref.size = idx;
+    // join order: most selective triple pattern first
+    for (i = 0; status == STATUS_OK && i < n; i++)
+    {
+        best = i;
+        best_score = -1;
 
-    return uriref;
-}
+        for (j = i; j < n; j++)
+        {
+            score = selectivity(vars[j], is_bound);
+            if (score > best_score)
+            {
+                best = j;
+                best_score = score;
+            }
+        }
 
-urdflib_t urdflib_create_bnode()
-{
-    static uint16_t counter = 0;
+        memcpy(state->patterns[i], patterns[best], sizeof(urdflib_t[3]));
+        memcpy(state->vars[i], vars[best], sizeof(urdflib_id_t[3]));
 
-    uint8_t buf[10];
-    size_t idx;
-    urdflib_t bnode;
+        // remove best from remaining triple patterns
+        memmove(patterns[best], patterns[i], sizeof(urdflib_t[3]));
+        memmove(vars[best], vars[i], sizeof(urdflib_id_t[3]));
+
+        for (j = 0; j < 3; j++)
+            if (state->vars[i][j] != NOT_A_VARIABLE)
+                is_bound[state->vars[i][j]] = true;
+    }
 
-    bnode.buffer = buf;
-    bnode.size = 10;
-    bnode.type = TYPE_BNODE;
+    mem_free(alloc, patterns, n * sizeof(urdflib_t[3]) + 1);
+    mem_free(alloc, vars, n * sizeof(urdflib_id_t[3]) + 1);
+    mem_free(alloc, ids, nb_ids * sizeof(urdflib_id_t) + 1);
+    mem_free(alloc, is_bound, state->nb_vars + 1);
 
-    idx = 0;
-    encode_bnode(&bnode, &idx, counter++);
+    if (status < STATUS_OK)
+    {
+        state_delete(state);
+        return status;
+    }
 
-    bnode.buffer = malloc(idx);
-    memcpy(bnode.buffer, buf, idx);
-    bnode.size = idx;
+    *out = state;
 
-    return bnode;
+    return STATUS_OK;
 }
 
-urdflib_t urdflib_create_literal(const char *str)
+/**
+ * Return the term to match at position pos of the triple pattern of a level
+ * (the bound term if the pattern has a bound variable), or NULL if unbound.
+ */
+const urdflib_t *pattern_term(const struct urdflib_state *state, size_t level, uint8_t pos)
 {
-    size_t len;
-    size_t idx;
-    urdflib_t lit;
+    urdflib_id_t var = state->vars[level][pos];
 
-    len = strlen(str);
+    if (var == NOT_A_VARIABLE)
+        return &state->patterns[level][pos];
+    else if (state->bound_at[var] > 0)
+        return &state->bindings[var];
+    else
+        return NULL;
+}
 
-    // size to allocate: 1 byte for CBOR head + string length
-    // FIXME unless len >= 24
-    lit.buffer = malloc(1 + len);
-    lit.size = 1 + len;
-    lit.type = TYPE_LITERAL;
+/**
+ * Position the cursor of a level at the start of the graph,
+ * building the subject index if the triple pattern has a bound subject.
+ */
+void state_reset(struct urdflib_state *state, const urdflib_t *g, size_t level)
+{
+    memset(&state->cursors[level], 0, sizeof(urdflib_ctx_t));
 
-    idx = 0;
-    encode_literal(&lit, &idx, str);
+    if (pattern_term(state, level, 0) != NULL && g->index == NULL && state->subjects == NULL &&
+        state->tape == NULL && directory_start(g) == 0)
+        state->subjects = index_create(g, state->alloc);
+}
 
-    return lit;
+void state_unbind(struct urdflib_state *state, size_t level)
+{
+    for (size_t v = 0; v < state->nb_vars; v++)
+        if (state->bound_at[v] == level + 1)
+            state->bound_at[v] = 0;
 }
 
-urdflib_t urdflib_create_literal_float(float nb)
+/**
+ * Find the next triple of g matching the triple pattern of a level
+ * and bind its unbound variables.
+ */
+int state_advance(struct urdflib_state *state, const urdflib_t *g, size_t level)
 {
-    uint8_t buf[6];
-    size_t idx;
-    urdflib_t lit;
+    int status;
+    uint8_t pos;
+    urdflib_id_t var;
+    bool is_match;
+    urdflib_t t[3];
+    const urdflib_t *term, *terms[3];
+    urdflib_ctx_t *cursor = &state->cursors[level];
 
-    lit.buffer = buf;
-    lit.size = 6;
-    lit.type = TYPE_LITERAL;
+    state_unbind(state, level);
 
-    idx = 0;
-    encode_literal_float(&lit, &idx, nb);
+    for (pos = 0; pos < 3; pos++)
+        terms[pos] = pattern_term(state, level, pos);
+
+    while (true)
+    {
+        if (state->tape != NULL)
+            status = tape_find_triples(state->tape, cursor, terms[0], terms[1], terms[2], &t[0], &t[1], &t[2]);
+        else
+            status = find_triples(g, cursor, g->index != NULL ? g->index : state->subjects,
+                                  terms[0], terms[1], terms[2], &t[0], &t[1], &t[2]);
+        if (status != STATUS_OK)
+            return status;
+
+        // bind variables (a variable may occur twice in a triple pattern)
+        is_match = true;
+        for (pos = 0; pos < 3 && is_match; pos++)
+        {
+            term = pattern_term(state, level, pos);
+            var = state->vars[level][pos];
+
+            if (term != NULL)
+                is_match = urdflib_cmp(term, &t[pos]) == 0;
+            else
+            {
+                state->bindings[var] = t[pos];
+                state->bound_at[var] = level + 1;
+            }
+        }
 
-    lit.buffer = malloc(idx);
-    memcpy(lit.buffer, buf, idx);
-    lit.size = idx;
+        if (is_match)
+            return STATUS_OK;
 
-    return lit;
+        state_unbind(state, level);
+    }
 }
 
-urdflib_t urdflib_create_literal_date(uint64_t unix_ts)
+/**
+ * Encode bound terms into mapping mu, as an array indexed by variable
+ * (unbound variables and indexes without variable are encoded as undefined).
+ */
+int encode_mapping(const struct urdflib_state *state, urdflib_t *mu)
 {
-    uint8_t buf[6];
-    size_t idx;
-    urdflib_t lit;
+    int status;
+    size_t size, idx, k;
+
+    size = head_size(state->mapping_size) + state->mapping_size - state->nb_vars;
+    for (size_t v = 0; v < state->nb_vars; v++)
+        size += state->bound_at[v] > 0 ? state->bindings[v].size : 1;
+
+    mu->type = TYPE_MAPPING;
+    mu->size = 0;
+
+    status = reserve(mu, size);
+    if (status < STATUS_OK)
+        return status;
 
-    lit.buffer = buf;
-    lit.size = 6;
-    lit.type = TYPE_LITERAL;
+    mu->size = size;
 
     idx = 0;
-    encode_literal_date(&lit, &idx, unix_ts);
+    idx += cbor_encode_array_start(state->mapping_size, mu->buffer, mu->size);
+
+    // slots are sorted by variable index
+    k = 0;
+    for (size_t v = 0; v < state->mapping_size; v++)
+    {
+        if (k < state->nb_vars && state->var_ids[k] == v && state->bound_at[k] > 0)
+            encode_value(mu, &idx, &state->bindings[k]);
+        else
+            idx += cbor_encode_undef(mu->buffer + idx, mu->size - idx);
 
-    lit.buffer = malloc(idx);
-    memcpy(lit.buffer, buf, idx);
-    lit.size = idx;
+        if (k < state->nb_vars && state->var_ids[k] == v)
+            k++;
+    }
 
-    return lit;
+    return STATUS_OK;
 }
 
-urdflib_t urdflib_create_typed_literal(const char *lex, const urdflib_t *dtype)
+/**
+ * Find the next solution of q in g, matching triple patterns on tape if not NULL.
+ */
+int find_next_mapping(const urdflib_t *g, const urdflib_tape_t *tape, urdflib_ctx_t *ctx, urdflib_t *q, urdflib_t *mu)
 {
-    size_t len;
-    size_t idx;
-    urdflib_t lit;
+    int status = STATUS_NO_ITEM;
+    struct urdflib_state *state;
 
-    // TODO 10 is a magic number here
-    // should instead first encode dtype, then allocate.
-    len = strlen(lex) + 10;
+    STATS_ADD(find_next_mapping_calls, 1);
 
-    lit.buffer = malloc(len);
-    lit.size = len;
-    lit.type = TYPE_LITERAL;
+    if (!is_graph(g) || !is_graph(q))
+        return STATUS_ARG_ERROR;
 
-    idx = 0;
-    encode_typed_literal(&lit, &idx, lex, dtype);
+    if (ctx->state == NULL)
+    {
+        status = state_create(g, q, &ctx->state);
+        if (status < STATUS_OK)
+            return status;
 
-    lit.buffer = realloc(lit.buffer, idx);
-    // TODO check buffer isn't NULL
-    lit.size = idx;
+        ctx->state->tape = tape;
+    }
 
-    return lit;
-}
+    state = ctx->state;
 
-urdflib_t urdflib_create_variable(uint16_t var_idx)
-{
-    uint8_t buf[6];
-    size_t idx;
-    urdflib_t var;
+    if (!state->is_started)
+    {
+        state->is_started = true;
+        state->level = 0;
 
-    var.buffer = buf;
-    var.size = 6;
-    var.type = TYPE_VARIABLE;
+        // empty graph pattern: a single empty mapping
+        if (state->nb_patterns == 0)
+            return encode_mapping(state, mu);
 
-    idx = 0;
-    encode_variable(&var, &idx, var_idx);
+        state_reset(state, g, 0);
+    }
+
+    // backtracking search, resumed from the last triple pattern
+    while (state->nb_patterns > 0)
+    {
+        status = state_advance(state, g, state->level);
+
+        if (status == STATUS_OK && state->level + 1 == state->nb_patterns)
+            return encode_mapping(state, mu);
+        else if (status == STATUS_OK)
+            state_reset(state, g, ++state->level);
+        else if (status == STATUS_NO_ITEM && state->level > 0)
+            state->level--;
+        else
+            break;
+    }
 
-    var.buffer = malloc(idx);
-    memcpy(var.buffer, buf, idx);
-    var.size = idx;
+    urdflib_ctx_delete(ctx);
 
-    return var;
+    return status;
 }
 
-urdflib_t urdflib_create_graph()
+int urdflib_find_next_mapping(const urdflib_t *g, urdflib_ctx_t *ctx, urdflib_t *q, urdflib_t *mu)
 {
-    size_t idx;
-    urdflib_t g;
-
-    g.buffer = malloc(BUFFER_SIZE);
-    g.size = BUFFER_SIZE;
-    g.type = TYPE_GRAPH;
+    return find_next_mapping(g, NULL, ctx, q, mu);
+}
 
-    idx = 0;
-    encode_graph_start(&g, &idx, NULL);
+int urdflib_tape_find_next_mapping(const urdflib_tape_t *tape, urdflib_ctx_t *ctx, urdflib_t *q, urdflib_t *mu)
+{
+    if (tape->subjects == NULL)
+        return STATUS_ARG_ERROR;
 
-    return g;
+    return find_next_mapping(&tape->g, tape, ctx, q, mu);
 }
 
-urdflib_t urdflib_create_named_graph(const urdflib_t *name)
+urdflib_t urdflib_create_mapping()
 {
-    size_t idx;
-    urdflib_t g;
+    urdflib_t mu;
 
-    g.buffer = malloc(BUFFER_SIZE);
-    g.size = BUFFER_SIZE;
-    g.type = TYPE_GRAPH;
-
-    idx = 0;
-    encode_graph_start(&g, &idx, name);
+    init_term(&mu, NULL, 0, TYPE_MAPPING, 0);
 
-    return g;
+    return mu;
 }
 
-int urdflib_add_triple(urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o)
+int urdflib_get_binding(const urdflib_t *mu, urdflib_id_t var_idx, urdflib_t *val)
 {
     int status;
     size_t idx;
-    urdflib_t id;
-    bool node_found, node_first, node_last;
+    urdflib_token_t token;
 
-    if (!is_graph(g))
-        return STATUS_ARG_ERROR;
-    if (!is_uriref(s) && !is_bnode(s))
-        return STATUS_ARG_ERROR;
-    if (!is_uriref(p))
-        return STATUS_ARG_ERROR;
-    if (!is_uriref(s) && !is_bnode(s) && !is_literal(s))
+    if (!is_mapping(mu))
         return STATUS_ARG_ERROR;
 
-    status = 0;
     idx = 0;
-    node_found = false;
-    node_first = true;
-    node_last = true;
+    status = decode_token(mu, &idx, &token);
+    if (token.type != TOKEN_ARRAY_START)
+        return STATUS_BUFFER_ERROR;
 
-    status = decode_graph_start(g, &idx, NULL);
+    if (var_idx >= token.value)
+        return STATUS_NO_ITEM;
 
-    do
+    for (urdflib_id_t v = 0; v < var_idx && status == STATUS_OK; v++)
     {
-        status = decode_node_start(g, &idx, &id);
-
-        if (status == STATUS_OK && urdflib_cmp(s, &id) == 0)
-            node_found = true;
+        // undefined
+        if (mu->buffer[idx] == 0xF7)
+            idx++;
+        else
+            status = decode_value(mu, &idx, NULL);
+    }
 
-        if (status == STATUS_OK)
-            status = decode_pairs(g, &idx);
-        if (status == STATUS_OK && !node_found)
-            status = decode_node_end(g, &idx);
-    } while (status == STATUS_OK && !node_found);
+    if (status < STATUS_OK)
+        return status;
 
-    if (!node_found)
-        status = encode_node_start(g, &idx, s);
-    // TODO missing break if not first node
-    else if (decode_node_start(g, &idx, &id) == STATUS_OK)
-    {
-        // if node found and not last, interleave
-        // TODO realloc
-        node_last = false;
-        return -100;
-    }
+    if (mu->buffer[idx] == 0xF7)
+        return STATUS_NO_ITEM;
 
-    status = encode_key(g, &idx, p);
-    status = encode_value(g, &idx, o);
+    return decode_value(mu, &idx, val);
+}
 
-    status = encode_node_end(g, &idx);
+void urdflib_ctx_delete(urdflib_ctx_t *ctx)
+{
+    if (ctx->state != NULL)
+        state_delete(ctx->state);
 
-    if (node_last)
-        status = encode_graph_end(g, &idx);
-    else
-    {
-        // TODO copy rest of nodes to buffer
-    }
+    ctx->state = NULL;
+}
 
-    return status;
+void urdflib_freeze(urdflib_t *x)
+{
+    urdflib_freeze_with(x, 0);
 }
 
-int find_node(const urdflib_t *g, urdflib_ctx_t *ctx, urdflib_t *id)
+int urdflib_freeze_with(urdflib_t *x, uint8_t options)
 {
     int status;
-    size_t node_idx;
+    uint8_t *buffer;
 
-    if (!is_graph(g))
-        STATUS_ARG_ERROR;
+    if (is_graph(x) && x->removed_size > 0)
+    {
+        status = urdflib_compact(x);
+        if (status < STATUS_OK)
+            return status;
+    }
 
-    if (ctx->idx == 0)
-        status = decode_graph_start(g, &(ctx->idx), NULL);
+    if (is_graph(x) || is_dataset(x))
+        index_delete(x);
 
-    if (ctx->node_idx == 0)
+    if (options & URDFLIB_FREEZE_SORTED)
     {
-        ctx->node_idx = ctx->idx;
-        status = decode_node_start(g, &(ctx->idx), id);
+        if (!is_graph(x))
+            return STATUS_ARG_ERROR;
+
+        status = sort_graph(x);
+        if (status < STATUS_OK)
+            return status;
     }
-    else
+
+    if (options & URDFLIB_FREEZE_DIRECTORY)
     {
-        node_idx = ctx->node_idx;
-        status = decode_node_start(g, &node_idx, id);
-    }
+        if (!is_graph(x) && !is_dataset(x))
+            return STATUS_ARG_ERROR;
 
-    return status;
-}
+        if (directory_start(x) == 0)
+        {
+            status = directory_append(x);
+            if (status < STATUS_OK)
+                return status;
+        }
+    }
 
-int find_key(const urdflib_t *g, urdflib_ctx_t *ctx, urdflib_t *key)
-{
-    int status;
-    size_t key_idx;
+    // buffer not owned by uRDFLib or already frozen
+    if (x->capacity <= x->size)
+        return STATUS_OK;
 
-    if (!is_graph(g))
-        STATUS_ARG_ERROR;
+    buffer = x->alloc->reallocate(x->alloc->state, x->buffer, x->capacity, x->size);
+    if (buffer == NULL)
+        return STATUS_OK;
 
-    if (ctx->key_idx == 0)
-    {
-        ctx->key_idx = ctx->idx;
-        status = decode_key(g, &(ctx->idx), key);
+    x->buffer = buffer;
+    x->capacity = x->size;
 
-        if (status == STATUS_NO_ITEM)
-            decode_node_end(g, &(ctx->idx));
-    }
-    else
-    {
-        key_idx = ctx->key_idx;
-        status = decode_key(g, &key_idx, key);
-    }
+    return STATUS_OK;
+}
 
-    return status;
+void urdflib_delete(urdflib_t *x)
+{
+    if (x->capacity > 0)
+        mem_free(x->alloc, x->buffer, x->capacity);
+    if (is_graph(x) || is_dataset(x))
+        index_delete(x);
+    x->buffer = NULL;
+    x->size = 0;
+    x->capacity = 0;
+    x->last_node_idx = 0;
+    x->removed_size = 0;
+    x->alloc = NULL;
 }
 
-int find_value(const urdflib_t *g, urdflib_ctx_t *ctx, urdflib_t *val)
+/*******************************************************************************
+ * Functions to read and write files.
+ ******************************************************************************/
+
+#ifndef URDFLIB_NO_FILES
+
+int urdflib_open_file(const char *path, uint8_t type, urdflib_t *x)
 {
-    int status;
+    int fd;
+    struct stat st;
+    void *buffer;
     size_t idx;
 
-    if (!is_graph(g))
-        STATUS_ARG_ERROR;
+    init_term(x, NULL, 0, type, 0);
 
-    // TODO support multiple values
-    ctx->has_single_value = true;
+    if (type != TYPE_GRAPH && type != TYPE_DATASET)
+        return STATUS_ARG_ERROR;
 
-    // TODO return error if break not found
-    // status = decode_values_start(g, &(ctx->idx));
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return STATUS_IO_ERROR;
 
-    status = decode_value(g, &(ctx->idx), val);
+    if (fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        close(fd);
+        return STATUS_IO_ERROR;
+    }
 
-    if (!ctx->has_single_value)
-        status = decode_values_end(g, &(ctx->idx));
+    // the mapping remains valid once the file is closed
+    buffer = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buffer == MAP_FAILED)
+        return STATUS_IO_ERROR;
 
-    return status;
+    // capacity 0: never reallocated, freed or modified
+    init_term(x, buffer, st.st_size, type, st.st_size);
+
+    idx = 0;
+    if (decode_graph_start(x, &idx, NULL) < STATUS_OK)
+    {
+        urdflib_close_file(x);
+        return STATUS_BUFFER_ERROR;
+    }
+
+    return STATUS_OK;
 }
 
-int urdflib_find_next_triple(const urdflib_t *g, urdflib_ctx_t *ctx, urdflib_t *s, urdflib_t *p, urdflib_t *o)
+void urdflib_close_file(urdflib_t *x)
 {
-    int status;
+    if (x->buffer != NULL)
+        munmap(x->buffer, x->size);
 
-    if (!is_graph(g))
-        STATUS_ARG_ERROR;
+    index_delete(x);
+    x->buffer = NULL;
+    x->size = 0;
+}
 
-    status = find_node(g, ctx, s);
-    if (status != STATUS_OK)
-        return status;
+/**
+ * Synchronize the directory holding path to disk, for a rename in it to be durable.
+ */
+int sync_directory(const char *path)
+{
+    int fd, status;
+    size_t len;
+    char *dir_path;
+    const char *slash = strrchr(path, '/');
 
-    status = find_key(g, ctx, p);
-    if (status != STATUS_OK && status != STATUS_NO_ITEM)
-        return status;
+    // "." or the path up to its last slash ("/" for the root)
+    len = slash == NULL ? 1 : slash == path ? 1 : (size_t)(slash - path);
+    dir_path = mem_alloc(default_allocator, len + 1);
+    if (dir_path == NULL)
+        return STATUS_MALLOC_ERROR;
 
-    if (status == STATUS_NO_ITEM)
-    {
-        ctx->node_idx = 0;
-        ctx->key_idx = 0;
-        return urdflib_find_next_triple(g, ctx, s, p, o);
-    }
+    memcpy(dir_path, slash == NULL ? "." : path, len);
+    dir_path[len] = '\0';
 
-    status = find_value(g, ctx, o);
-    if (status != STATUS_OK && status != STATUS_NO_ITEM)
-        return status;
+    status = STATUS_OK;
+    fd = open(dir_path, O_RDONLY);
+    if (fd < 0 || fsync(fd) < 0)
+        status = STATUS_IO_ERROR;
+    if (fd >= 0)
+        close(fd);
 
-    if (ctx->has_single_value)
-        ctx->key_idx = 0;
-    else if (status == STATUS_NO_ITEM)
-    {
-        ctx->key_idx = 0;
-        return urdflib_find_next_triple(g, ctx, s, p, o);
-    }
+    mem_free(default_allocator, dir_path, len + 1);
 
     return status;
 }
 
-void urdflib_freeze(urdflib_t *x)
+/**
+ * Suffix of the temporary files of urdflib_save_file (names are unique thanks to O_EXCL).
+ */
+static unsigned save_counter;
+
+int urdflib_save_file(const urdflib_t *x, const char *path)
 {
-    int status;
-    size_t idx;
+    int fd, status;
+    size_t len, written;
+    ssize_t n;
+    char *tmp_path;
+
+    // unique name next to path, so that concurrent saves do not clobber each other:
+    // path.<pid>.<counter>.tmp, created exclusively (another name is tried if it exists)
+    len = strlen(path) + 32;
+    tmp_path = mem_alloc(default_allocator, len);
+    if (tmp_path == NULL)
+        return STATUS_MALLOC_ERROR;
 
-    if (is_graph(x))
+    do
     {
-        idx = 0;
-        status = decode_graph_start(x, &idx, NULL);
+        snprintf(tmp_path, len, "%s.%ld.%u.tmp", path, (long)getpid(), save_counter++);
+        fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    } while (fd < 0 && (errno == EEXIST || errno == EINTR));
 
-        while (status == STATUS_OK)
-        {
-            status = decode_node_start(x, &idx, NULL);
-            if (status < STATUS_OK)
-                break;
+    status = fd < 0 ? STATUS_IO_ERROR : STATUS_OK;
 
-            status = decode_pairs(x, &idx);
-            if (status < STATUS_OK)
-                break;
+    written = 0;
+    while (status == STATUS_OK && written < x->size)
+    {
+        n = write(fd, x->buffer + written, x->size - written);
+        if (n < 0 && errno != EINTR)
+            status = STATUS_IO_ERROR;
+        else if (n > 0)
+            written += n;
+    }
 
-            status = decode_node_end(x, &idx);
-        }
+    if (status == STATUS_OK && fsync(fd) < 0)
+        status = STATUS_IO_ERROR;
+    if (fd >= 0 && close(fd) < 0)
+        status = STATUS_IO_ERROR;
 
-        if (status == STATUS_NO_ITEM)
-            status = decode_graph_end(x, &idx);
+    // readers see either the previous file or the new one
+    if (status == STATUS_OK && rename(tmp_path, path) < 0)
+        status = STATUS_IO_ERROR;
+    if (status < STATUS_OK && fd >= 0)
+        unlink(tmp_path);
 
-        // TODO memory leak if error status
-        x->buffer = realloc(x->buffer, idx);
-        x->size = idx;
-    }
+    // the rename itself is durable once the directory is synchronized
+    if (status == STATUS_OK)
+        status = sync_directory(path);
+
+    mem_free(default_allocator, tmp_path, len);
+
+    return status;
 }
 
-void urdflib_delete(urdflib_t *x)
-{
-    free(x->buffer);
-    x->size = 0;
-}
\ No newline at end of file
+#endif
@@ -10,11 +10,10 @@ extern "C"
  * @file
  * @brief Main uRDFLib namespace
  */
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
-    // TODO current impl limits ctx size to 2^16. Make it configurable.
-
 #define TYPE_DATASET 0
 #define TYPE_GRAPH 1
 #define TYPE_MAPPING 2
@@ -32,6 +31,148 @@ extern "C"
 #define STATUS_BUFFER_ERROR -3
 #define STATUS_ARG_ERROR -4
 #define STATUS_MALLOC_ERROR -5
+#define STATUS_NEED_INPUT -6
+#define STATUS_IO_ERROR -7
+
+/**
+ * Status returned (not an error) when a triple added with URDFLIB_ADD_UNIQUE
+ * is already in the graph.
+ */
+#define STATUS_EXISTS 1
+
+/**
+ * Files are read and written with POSIX functions,
+ * not available on Arduino boards.
+ */
+#if defined(ARDUINO) && !defined(URDFLIB_NO_FILES)
+#define URDFLIB_NO_FILES
+#endif
+
+/**
+ * Graphs are scanned in parallel with POSIX threads,
+ * not available on Arduino boards.
+ */
+#if defined(ARDUINO) && !defined(URDFLIB_NO_THREADS)
+#define URDFLIB_NO_THREADS
+#endif
+
+/**
+ * Options of urdflib_freeze_with.
+ */
+#define URDFLIB_FREEZE_DIRECTORY 0x01
+#define URDFLIB_FREEZE_SORTED 0x02
+
+/**
+ * Options of urdflib_add_triple_with.
+ */
+#define URDFLIB_ADD_UNIQUE 0x01
+
+/**
+ * Number of buckets of latency histograms (see urdflib_stats_t).
+ */
+#define URDFLIB_STATS_BUCKETS 32
+
+/**
+ * Term indices, CURIE ids and variable indices are 16-bit integers,
+ * or 32-bit integers if uRDFLib is compiled with URDFLIB_WIDE_IDS.
+ * Either way, they are encoded as the shortest CBOR unsigned integer.
+ */
+#ifdef URDFLIB_WIDE_IDS
+typedef uint32_t urdflib_id_t;
+#define URDFLIB_ID_MAX UINT32_MAX
+#else
+typedef uint16_t urdflib_id_t;
+#define URDFLIB_ID_MAX UINT16_MAX
+#endif
+
+/**
+ * Storage size large enough for any term encoded by uRDFLib,
+ * except string and typed literals.
+ */
+#define URDFLIB_TERM_SIZE 16
+
+/**
+ * Storage size of incremental parsers, bounding the size of
+ * a subject, a predicate and an object held at once.
+ */
+#ifndef URDFLIB_PARSER_SIZE
+#define URDFLIB_PARSER_SIZE 256
+#endif
+
+/**
+ * Storage size of streaming writers, bounding the size of
+ * a predicate and its object held until the next triple is written.
+ */
+#ifndef URDFLIB_WRITER_SIZE
+#define URDFLIB_WRITER_SIZE 256
+#endif
+
+    /**
+     * Memory allocator used for uRDFLib buffers.
+     * All functions get the allocator's state as first argument.
+     * Sizes of previous allocations are given back to the allocator
+     * when reallocating or freeing memory.
+     */
+    typedef struct
+    {
+        void *(*allocate)(void *state, size_t size);
+        void *(*reallocate)(void *state, void *ptr, size_t old_size, size_t size);
+        void (*deallocate)(void *state, void *ptr, size_t size);
+        void *state;
+    } urdflib_allocator_t;
+
+    /**
+     * Bump allocator serving allocations from a single memory region,
+     * all released at once with urdflib_arena_reset().
+     */
+    typedef struct
+    {
+        uint8_t *buffer;
+        size_t size;
+        size_t used;
+        size_t last; // offset of the last allocation (can grow in place)
+        urdflib_allocator_t allocator;
+    } urdflib_arena_t;
+
+    /**
+     * Generator of blank node identifiers (64-bit),
+     * which can be shared between threads (identifiers are taken atomically).
+     */
+    typedef struct
+    {
+        uint64_t next;
+    } urdflib_bnode_gen_t;
+
+    /**
+     * Dictionary translating IRIs to terms (term indices or CURIEs) and back,
+     * with a perfect hash table in each direction.
+     * Keys are concatenated, the offsets of key i being offsets[i] and offsets[i + 1].
+     * A dictionary is either loaded at run time (see urdflib_dict_parse)
+     * or generated as constant C data at build time (see urdflib_dict_write_c).
+     */
+    typedef struct
+    {
+        size_t size;       // number of entries
+        size_t nb_buckets; // buckets of both hash tables
+        size_t nb_slots;   // slots of both hash tables
+        const char *iris;
+        const uint32_t *iri_offsets;
+        const uint8_t *terms; // encoded terms
+        const uint32_t *term_offsets;
+        const uint32_t *iri_displacements; // per bucket
+        const uint32_t *iri_slots;         // entry of each slot (UINT32_MAX if empty)
+        const uint32_t *term_displacements;
+        const uint32_t *term_slots;
+        void *storage; // memory holding all arrays (NULL if generated)
+        size_t storage_size;
+        const urdflib_allocator_t *alloc;
+    } urdflib_dict_t;
+
+    /**
+     * Side index mapping subjects to node offsets in a graph buffer
+     * (opaque, managed by uRDFLib).
+     */
+    struct urdflib_index;
 
     /**
      * Generic buffer encoding either:
@@ -39,12 +180,22 @@ extern "C"
      * - a dataset,
      * - a mapping (the result of evaluating a graph pattern against a graph/dataset) or
      * - an RDF node (URI reference, blank node or literal).
+     *
+     * The size is the number of bytes actually encoded in the buffer
+     * while the capacity is the number of bytes allocated for it.
+     * A capacity of 0 denotes a buffer not owned by uRDFLib
+     * (e.g. a static array), which is never reallocated nor freed.
      */
     typedef struct
     {
         uint8_t *buffer;
         size_t size;
         uint8_t type;
+        size_t capacity;
+        size_t last_node_idx; // graph only: offset of the last node (0 if none)
+        struct urdflib_index *index; // graph only: subject index (NULL if not built)
+        size_t removed_size; // graph only: bytes of removed triples not compacted yet
+        const urdflib_allocator_t *alloc; // allocator of the buffer (NULL if not owned yet)
     } urdflib_t;
 
     /**
@@ -61,8 +212,152 @@ extern "C"
         size_t node_idx;
         size_t key_idx;
         bool has_single_value;
+        size_t graph_idx;            // dataset only: offset of the current graph
+        struct urdflib_state *state; // pattern matching only (opaque, created on first call)
     } urdflib_ctx_t;
 
+    /**
+     * Range of whole nodes of a graph, from the offset of its first node
+     * to the offset after its last node (see urdflib_split_graph).
+     */
+    typedef struct
+    {
+        size_t start;
+        size_t end;
+    } urdflib_range_t;
+
+    /**
+     * Tape of a graph (see urdflib_tape_build): its nodes, pairs and terms
+     * decoded once, in graph order, so that traversals do not decode CBOR again.
+     */
+    typedef struct
+    {
+        urdflib_t g;                        // the graph (buffer not owned)
+        struct urdflib_tape_entry *entries; // opaque
+        size_t size;                        // number of entries
+        size_t capacity;
+        struct urdflib_index *subjects; // entry of each subject
+    } urdflib_tape_t;
+
+    /**
+     * Function called for each triple found by urdflib_scan_parallel,
+     * with the state of the calling thread.
+     * Terms point into the graph and remain valid as long as the graph is not modified.
+     *
+     * @return STATUS_OK to continue or an error code to stop the scan
+     */
+    typedef int (*urdflib_triple_callback_t)(void *state, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o);
+
+    /**
+     * State of an incremental parser reading a graph from chunks of bytes
+     * (see urdflib_parser_feed). It only holds the current subject, predicate
+     * and the token or term being read, never the whole graph.
+     */
+    typedef struct
+    {
+        const uint8_t *input; // current chunk (owned by the caller)
+        size_t input_size;
+        size_t input_idx;
+        uint8_t state;
+        uint8_t nb_tokens;   // tokens left before the term being read is complete
+        size_t subject_size; // buffer: subject, predicate, then term being read
+        size_t key_size;
+        size_t term_size;
+        size_t token_size; // bytes of the term being read that form complete tokens
+        size_t skipped_size; // payload bytes skipped so far of a removed term (never buffered)
+        uint8_t buffer[URDFLIB_PARSER_SIZE];
+    } urdflib_parser_t;
+
+    /**
+     * State of a streaming writer encoding a graph into a sink
+     * (e.g. a file descriptor, a socket or a ring buffer) through a small staging buffer,
+     * flushed with the write function of the writer (see urdflib_writer_init).
+     */
+    typedef struct
+    {
+        int (*write)(void *state, const uint8_t *data, size_t size);
+        void *state;
+        size_t size;     // number of bytes staged
+        size_t pair_idx; // offset of the last pair while it has a single value
+        bool has_node;
+        bool has_pair;
+        bool has_values; // if true, the last pair's values are encoded as an array
+        size_t subject_size;
+        size_t key_size;
+        uint8_t subject[URDFLIB_TERM_SIZE];
+        uint8_t key[URDFLIB_TERM_SIZE];
+        uint8_t buffer[URDFLIB_WRITER_SIZE];
+    } urdflib_writer_t;
+
+#ifdef URDFLIB_STATS
+    /**
+     * Statistics on the work done by uRDFLib in the calling thread,
+     * collected if uRDFLib is compiled with URDFLIB_STATS.
+     * Bucket i of latency histograms counts calls that took between 2^i and 2^(i+1) ns.
+     */
+    typedef struct
+    {
+        uint64_t tokens_decoded;
+        uint64_t bytes_decoded;  // bytes of all tokens decoded
+        uint64_t nodes_skipped;  // nodes scanned while looking for a subject
+        uint64_t pairs_skipped;  // pairs skipped while looking for a predicate
+        uint64_t bytes_encoded;  // bytes inserted into graph buffers
+        uint64_t bytes_moved;    // bytes shifted to insert bytes into graph buffers
+        uint64_t triples_removed;
+        uint64_t bytes_compacted; // bytes of removed triples reclaimed by compaction
+        uint64_t allocations;
+        uint64_t reallocations;
+        uint64_t deallocations;
+        uint64_t add_triple_calls;
+        uint64_t add_triples_calls;
+        uint64_t find_next_triple_calls;
+        uint64_t find_triples_calls;
+        uint64_t find_next_mapping_calls;
+        uint64_t add_triple_latency[URDFLIB_STATS_BUCKETS];
+        uint64_t find_next_triple_latency[URDFLIB_STATS_BUCKETS];
+    } urdflib_stats_t;
+
+    /**
+     * Get the statistics of the calling thread since the last reset.
+     *
+     * @param[out] stats the statistics
+     */
+    void urdflib_stats_get(urdflib_stats_t *stats);
+
+    /**
+     * Reset the statistics of the calling thread.
+     */
+    void urdflib_stats_reset();
+#endif
+
+    /**
+     * Set the allocator used by all urdflib_create_* functions
+     * (not thread-safe, to be called before creating any buffer).
+     * Buffers keep track of the allocator they were created with.
+     *
+     * @param[in] alloc an allocator or NULL to use the C standard library
+     */
+    void urdflib_set_allocator(const urdflib_allocator_t *alloc);
+
+    /**
+     * Initialize a bump allocator over the given memory region.
+     * Freeing memory is a no-op, except for the last allocation.
+     *
+     * @param[out] arena the arena
+     * @param[in] buffer a memory region
+     * @param[in] size the size of the memory region
+     * @return the allocator serving memory from the arena
+     */
+    const urdflib_allocator_t *urdflib_arena_init(urdflib_arena_t *arena, uint8_t *buffer, size_t size);
+
+    /**
+     * Release all memory allocated from the arena at once.
+     * Buffers allocated from the arena must not be used afterwards.
+     *
+     * @param[inout] arena the arena
+     */
+    void urdflib_arena_reset(urdflib_arena_t *arena);
+
     /**
      * Print a readable representation of buffer x (for debugging purposes).
      *
@@ -71,20 +366,49 @@ extern "C"
     void urdflib_print(const urdflib_t *x);
 
     /**
-     * Compare two uRDFLib buffers.
+     * Compare two uRDFLib buffers, in a total order:
+     * by type, then in bytewise lexicographic order of their encoding
+     * (the order of subjects, keys and values in sorted graphs, see URDFLIB_FREEZE_SORTED).
      *
      * @param[in] x a buffer
      * @param[in] y another buffer
+     * @return a negative number, 0 or a positive number if x is lower than, equal to or greater than y
      */
     int urdflib_cmp(const urdflib_t *x, const urdflib_t *y);
 
     /**
-     * Free any extra memory allocated for buffer x.
+     * Free any extra memory allocated for buffer x
+     * (i.e. shrink its capacity to its size and drop its subject index,
+     * which is rebuilt if more triples are added later).
      *
      * @param[inout] x a buffer
      */
     void urdflib_freeze(urdflib_t *x);
 
+    /**
+     * Freeze buffer x (see urdflib_freeze) with options:
+     * - URDFLIB_FREEZE_DIRECTORY appends a directory of subjects to a graph
+     *   (or of graph names to a dataset),
+     *   sorted by subject hash with the offset of each node, for O(log n) lookups
+     *   by urdflib_find_triples. The directory is a second CBOR item after the graph
+     *   (a CBOR sequence), which readers that ignore it never reach.
+     *   It is dropped if more triples are added later.
+     * - URDFLIB_FREEZE_SORTED rewrites a graph in canonical order: nodes sorted by subject,
+     *   pairs by key and values of each pair (duplicate triples being dropped),
+     *   all in bytewise order of their encoding (see urdflib_cmp).
+     *   Graphs with the same triples are then byte-identical
+     *   (as long as they have the same name and the same blank node identifiers),
+     *   and sorted graphs are merged in order by urdflib_graph_merge.
+     *   Triples added later are appended in insertion order.
+     *
+     * Triples removed from a graph are compacted first (see urdflib_compact).
+     *
+     * @param[inout] x a buffer
+     * @param[in] options a combination of URDFLIB_FREEZE_* flags
+     * @return a status code
+     */
+    int urdflib_freeze_with(urdflib_t *x, uint8_t options);
+
     /**
      * Free all memory allocated for buffer x.
      *
@@ -92,6 +416,38 @@ extern "C"
      */
     void urdflib_delete(urdflib_t *x);
 
+#ifndef URDFLIB_NO_FILES
+    /**
+     * Map a file holding a (frozen) graph or dataset into memory, read-only.
+     * The buffer of x points to the mapping: no copy is made and pages are only read
+     * when iterating over x. Triples cannot be added to x.
+     *
+     * @param[in] path the path of the file
+     * @param[in] type TYPE_GRAPH or TYPE_DATASET
+     * @param[out] x the graph or dataset, to be released with urdflib_close_file
+     * @return a status code
+     */
+    int urdflib_open_file(const char *path, uint8_t type, urdflib_t *x);
+
+    /**
+     * Unmap a file mapped by urdflib_open_file.
+     *
+     * @param[inout] x the graph or dataset
+     */
+    void urdflib_close_file(urdflib_t *x);
+
+    /**
+     * Write buffer x (e.g. a frozen graph or dataset) to a file atomically and durably:
+     * it is written to a temporary file of a unique name next to it (path followed by a process-unique suffix),
+     * synchronized to disk and then renamed, the directory being synchronized as well.
+     *
+     * @param[in] x a buffer
+     * @param[in] path the path of the file
+     * @return a status code
+     */
+    int urdflib_save_file(const urdflib_t *x, const char *path);
+#endif
+
     /**
      * Create an empty anonymous graph.
      */
@@ -104,21 +460,48 @@ extern "C"
      */
     urdflib_t urdflib_create_named_graph(const urdflib_t *name);
 
+    /**
+     * Create an empty graph (anonymous if name is NULL)
+     * whose memory is managed by the given allocator
+     * instead of the one set with urdflib_set_allocator().
+     *
+     * @param[in] name the graph name represented as a CURIE, or NULL
+     * @param[in] alloc an allocator
+     */
+    urdflib_t urdflib_create_graph_with(const urdflib_t *name, const urdflib_allocator_t *alloc);
+
     /**
      * Create a URIRef represented as a term index.
      */
-    urdflib_t urdflib_create_uriref(uint16_t id);
+    urdflib_t urdflib_create_uriref(urdflib_id_t id);
 
     /**
      * Create a URIRef represented as a CURIE.
      */
-    urdflib_t urdflib_create_uriref_curie(uint16_t ns_id, uint16_t local_id);
+    urdflib_t urdflib_create_uriref_curie(urdflib_id_t ns_id, urdflib_id_t local_id);
 
     /**
-     * Create a BNode with some auto-generated identifier.
+     * Create a BNode with some auto-generated identifier,
+     * unique in the process (see urdflib_create_bnode_with).
      */
     urdflib_t urdflib_create_bnode();
 
+    /**
+     * Initialize a generator of blank node identifiers, e.g. one per graph.
+     *
+     * @param[out] gen the generator
+     * @param[in] first the first identifier to generate
+     */
+    void urdflib_bnode_gen_init(urdflib_bnode_gen_t *gen, uint64_t first);
+
+    /**
+     * Create a BNode whose identifier is taken from the given generator,
+     * encoded in the shortest CBOR form.
+     *
+     * @param[inout] gen the generator
+     */
+    urdflib_t urdflib_create_bnode_with(urdflib_bnode_gen_t *gen);
+
     /**
      * Create a plain literal with a string lexical representation.
      *
@@ -151,10 +534,73 @@ extern "C"
     /**
      * Create a variable identified by an integer value
      * (which will become an index in some mapping).
+     * URDFLIB_ID_MAX is reserved and gives an empty term.
+     *
+     * @param[in] var_idx an integer value (below URDFLIB_ID_MAX)
+     */
+    urdflib_t urdflib_create_variable(urdflib_id_t var_idx);
+
+    /**
+     * Initialize a URIRef represented as a term index,
+     * encoded in the given storage (no memory allocation).
+     * Terms initialized that way must not be deleted.
      *
-     * @param[in] var_idx an integer value
+     * @param[out] x the term
+     * @param[in] buf storage for the encoded term
+     * @param[in] size the size of the storage
+     * @param[in] id the term index
+     * @return an error code or 0 if the storage was large enough
+     */
+    int urdflib_init_uriref(urdflib_t *x, uint8_t *buf, size_t size, urdflib_id_t id);
+
+    /**
+     * Initialize a URIRef represented as a CURIE, in the given storage.
+     * See urdflib_init_uriref().
+     */
+    int urdflib_init_uriref_curie(urdflib_t *x, uint8_t *buf, size_t size, urdflib_id_t ns_id, urdflib_id_t local_id);
+
+    /**
+     * Initialize a BNode with some auto-generated identifier, in the given storage.
+     * See urdflib_init_uriref().
+     */
+    int urdflib_init_bnode(urdflib_t *x, uint8_t *buf, size_t size);
+
+    /**
+     * Initialize a BNode whose identifier is taken from the given generator, in the given storage.
+     * See urdflib_init_uriref().
+     */
+    int urdflib_init_bnode_with(urdflib_t *x, uint8_t *buf, size_t size, urdflib_bnode_gen_t *gen);
+
+    /**
+     * Initialize a plain literal, in the given storage.
+     * See urdflib_init_uriref().
+     */
+    int urdflib_init_literal(urdflib_t *x, uint8_t *buf, size_t size, const char *str);
+
+    /**
+     * Initialize a float literal, in the given storage.
+     * See urdflib_init_uriref().
+     */
+    int urdflib_init_literal_float(urdflib_t *x, uint8_t *buf, size_t size, float nb);
+
+    /**
+     * Initialize a date literal, in the given storage.
+     * See urdflib_init_uriref().
+     */
+    int urdflib_init_literal_date(urdflib_t *x, uint8_t *buf, size_t size, uint64_t unix_ts);
+
+    /**
+     * Initialize a typed literal, in the given storage.
+     * See urdflib_init_uriref().
      */
-    urdflib_t urdflib_create_variable(uint16_t var_idx);
+    int urdflib_init_typed_literal(urdflib_t *x, uint8_t *buf, size_t size, const char *lex, const urdflib_t *dtype);
+
+    /**
+     * Initialize a variable, in the given storage.
+     * Return STATUS_ARG_ERROR if var_idx is URDFLIB_ID_MAX.
+     * See urdflib_init_uriref().
+     */
+    int urdflib_init_variable(urdflib_t *x, uint8_t *buf, size_t size, urdflib_id_t var_idx);
 
     /**
      * Add a triple to the given graph.
@@ -164,12 +610,113 @@ extern "C"
      * @param[in] p the predicate of the triple
      * @param[in] o the object of the triple
      * @return an error code or 0 if the triple was successfully added
+     *
+     * If the subject's node already has a value for p,
+     * o is added to the array of values of p (the value becomes an array if needed).
+     *
+     * The graph buffer grows geometrically when needed, such that
+     * appending triples is done in amortized constant time.
+     * Unless uRDFLib is compiled with URDFLIB_NO_SUBJECT_INDEX,
+     * the node of s is looked up in a subject index built on first use.
      */
     int urdflib_add_triple(urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o);
 
+    /**
+     * Add a triple to the given graph (see urdflib_add_triple) with options:
+     * - URDFLIB_ADD_UNIQUE skips the triple if it is already in the graph
+     *   (e.g. when a message is received twice). Only the values of p
+     *   in the node of s are searched, the node being found as by urdflib_add_triple.
+     *
+     * @param[inout] g the graph
+     * @param[in] s the subject of the triple
+     * @param[in] p the predicate of the triple
+     * @param[in] o the object of the triple
+     * @param[in] options a combination of URDFLIB_ADD_* flags
+     * @return an error code, STATUS_OK if the triple was added
+     *         or STATUS_EXISTS if it was already in the graph
+     */
+    int urdflib_add_triple_with(urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o, uint8_t options);
+
+    /**
+     * Add a batch of triples to the given graph.
+     * Triples are grouped by subject, the graph buffer is grown at most once
+     * and all nodes are encoded in a single pass over the buffer.
+     * The result is the same as adding triples one by one with urdflib_add_triple().
+     *
+     * @param[inout] g the graph that will include the added triples
+     * @param[in] triples an array of (subject, predicate, object) triples
+     * @param[in] n the number of triples in the array
+     * @return an error code or 0 if all triples were successfully added
+     */
+    int urdflib_add_triples(urdflib_t *g, const urdflib_t (*triples)[3], size_t n);
+
+    /**
+     * Remove a triple from the given graph.
+     * The triple is only marked as removed: its bytes are overwritten in place
+     * by tombstones of the same size (skipped by all readers),
+     * so that offsets, the subject index and the directory remain valid.
+     * The space is reclaimed all at once by urdflib_compact or urdflib_freeze.
+     *
+     * @param[inout] g the graph
+     * @param[in] s the subject of the triple
+     * @param[in] p the predicate of the triple
+     * @param[in] o the object of the triple
+     * @return an error code, STATUS_OK if the triple was removed
+     *         or STATUS_NO_ITEM if it was not in the graph
+     */
+    int urdflib_remove_triple(urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o);
+
+    /**
+     * Remove all triples of graph g matching s, p and o (NULL for any term),
+     * as by urdflib_remove_triple.
+     *
+     * @param[inout] g the graph
+     * @param[in] s the subject to match, or NULL
+     * @param[in] p the predicate to match, or NULL
+     * @param[in] o the object to match, or NULL
+     * @return the number of triples removed or an error code
+     */
+    int urdflib_remove_triples(urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o);
+
+    /**
+     * Reclaim the space of triples removed from graph g in a single pass over the buffer:
+     * live bytes are moved down with one memmove per run between tombstones,
+     * predicates and subjects left without values are dropped,
+     * and arrays left with a single value are unwrapped.
+     * The subject index is dropped and the directory (if any) rebuilt.
+     * The capacity of g is unchanged (see urdflib_freeze).
+     *
+     * @param[inout] g the graph
+     * @return a status code
+     */
+    int urdflib_compact(urdflib_t *g);
+
+    /**
+     * Create an empty dataset, i.e. a set of named graphs.
+     * Graph names are indexed like subjects in graphs (see urdflib_add_triple).
+     */
     urdflib_t urdflib_create_dataset();
 
-    int urdflib_add_graph(urdflib_t *dataset, const uint8_t *graph);
+    /**
+     * Add (a copy of) named graph g to dataset ds.
+     * Triples removed from g are left out of the copy.
+     *
+     * @param[inout] ds the dataset
+     * @param[in] g a named graph (see urdflib_create_named_graph)
+     * @return a status code (STATUS_ARG_ERROR if g has no name or ds has a graph with the same name)
+     */
+    int urdflib_add_graph(urdflib_t *ds, const urdflib_t *g);
+
+    /**
+     * Find the named graph of a dataset, through the graph name index of the dataset,
+     * its directory (see urdflib_freeze_with) or by skipping other graphs.
+     *
+     * @param[in] ds the dataset
+     * @param[in] name the name of the graph
+     * @param[out] g the graph found (pointing into ds)
+     * @return a status code
+     */
+    int urdflib_find_graph(const urdflib_t *ds, const urdflib_t *name, urdflib_t *g);
 
     /**
      * Scan the input graph until a triple is found.
@@ -186,10 +733,358 @@ extern "C"
      */
     int urdflib_find_next_triple(const urdflib_t *g, urdflib_ctx_t *ctx, urdflib_t *s, urdflib_t *p, urdflib_t *o);
 
+    /**
+     * Find the next triple in graph g matching s, p and o (NULL for any term).
+     * If the subject is bound, only its node is read: it is found in the subject index
+     * of g if any, otherwise other nodes are skipped after their @id.
+     * Pairs whose key differs from a bound predicate are skipped without decoding their values.
+     *
+     * @param[in] g the graph
+     * @param[in,out] ctx the context of the search (zero-initialized before the first call)
+     * @param[in] s the subject to match, or NULL
+     * @param[in] p the predicate to match, or NULL
+     * @param[in] o the object to match, or NULL
+     * @param[out] s_out the subject of the next triple found (may be NULL)
+     * @param[out] p_out the predicate of the next triple found (may be NULL)
+     * @param[out] o_out the object of the next triple found (may be NULL)
+     * @return a status code
+     */
+    int urdflib_find_triples(const urdflib_t *g, urdflib_ctx_t *ctx,
+                             const urdflib_t *s, const urdflib_t *p, const urdflib_t *o,
+                             urdflib_t *s_out, urdflib_t *p_out, urdflib_t *o_out);
+
+    /**
+     * Split the nodes of graph g into at most n ranges of similar size in bytes,
+     * in order. Node offsets are taken from the directory of g (see urdflib_freeze_with)
+     * or its subject index if any. Otherwise, a pre-pass skips nodes up to the last boundary,
+     * reading CBOR heads only (terms are not decoded).
+     *
+     * @param[in] g the graph
+     * @param[out] ranges an array of n ranges
+     * @param[in] n the maximum number of ranges
+     * @return the number of (non-empty) ranges or an error code
+     */
+    int urdflib_split_graph(const urdflib_t *g, urdflib_range_t *ranges, size_t n);
+
+#ifndef URDFLIB_NO_THREADS
+    /**
+     * Call a function for each triple of graph g matching s, p and o (NULL for any term),
+     * on nb_threads threads (the calling thread included).
+     * The graph is split into several ranges per thread (see urdflib_split_graph):
+     * threads take the next range left as soon as they are done with theirs,
+     * so that ranges denser in matches do not leave other threads idle.
+     * Triples are found in graph order within a range, but ranges are scanned concurrently.
+     * If s is bound, its node is read by the calling thread only.
+     *
+     * The graph must not be modified during the scan. Statistics (see urdflib_stats_get)
+     * are collected in the threads doing the work.
+     *
+     * @param[in] g the graph
+     * @param[in] s the subject to match, or NULL
+     * @param[in] p the predicate to match, or NULL
+     * @param[in] o the object to match, or NULL
+     * @param[in] callback the function called for each triple found
+     * @param[in] states an array of nb_threads states, one per thread, passed to callback
+     *            (to be merged by the caller once the scan is done), or NULL
+     * @param[in] nb_threads the number of threads (at least 1)
+     * @return a status code (the first error returned by callback, if any)
+     */
+    int urdflib_scan_parallel(const urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o,
+                              urdflib_triple_callback_t callback, void *const *states, size_t nb_threads);
+
+    /**
+     * Count the triples of graph g matching s, p and o (NULL for any term)
+     * on nb_threads threads (see urdflib_scan_parallel).
+     *
+     * @param[in] g the graph
+     * @param[in] s the subject to match, or NULL
+     * @param[in] p the predicate to match, or NULL
+     * @param[in] o the object to match, or NULL
+     * @param[in] nb_threads the number of threads (at least 1)
+     * @param[out] count the number of triples found
+     * @return a status code
+     */
+    int urdflib_count_triples(const urdflib_t *g, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o,
+                              size_t nb_threads, size_t *count);
+#endif
+
+    /**
+     * Find the next quad in dataset ds, graph by graph.
+     *
+     * @param[in] ds the dataset
+     * @param[in,out] ctx the context of the search (zero-initialized before the first call)
+     * @param[out] s the subject of the next quad found
+     * @param[out] p the predicate of the next quad found
+     * @param[out] o the object of the next quad found
+     * @param[out] g the name of the graph of the next quad found (may be NULL)
+     * @return a status code
+     */
     int urdflib_find_next_quad(const urdflib_t *ds, urdflib_ctx_t *ctx, urdflib_t *s, urdflib_t *p, urdflib_t *o, urdflib_t *g);
 
+    /**
+     * Initialize an incremental parser, ready to read a graph (anonymous or named).
+     *
+     * @param[out] parser the parser
+     */
+    void urdflib_parser_init(urdflib_parser_t *parser);
+
+    /**
+     * Give the next chunk of a graph to a parser.
+     * The chunk must remain valid until urdflib_parser_next returns STATUS_NEED_INPUT
+     * (i.e. until all its bytes were read).
+     *
+     * @param[inout] parser the parser
+     * @param[in] chunk bytes following those of previous chunks
+     * @param[in] size the number of bytes of the chunk
+     */
+    void urdflib_parser_feed(urdflib_parser_t *parser, const uint8_t *chunk, size_t size);
+
+    /**
+     * Read the next complete triple from chunks given to a parser.
+     * Terms found point into the parser and remain valid until the next call.
+     * Terms longer than URDFLIB_PARSER_SIZE cannot be read (STATUS_BUFFER_ERROR).
+     *
+     * @param[inout] parser the parser
+     * @param[out] s the subject of the next triple found
+     * @param[out] p the predicate of the next triple found
+     * @param[out] o the object of the next triple found
+     * @return STATUS_OK if a triple was found, STATUS_NEED_INPUT if the chunk was fully read,
+     *         STATUS_NO_ITEM at the end of the graph or another status code on error
+     */
+    int urdflib_parser_next(urdflib_parser_t *parser, urdflib_t *s, urdflib_t *p, urdflib_t *o);
+
+    /**
+     * Initialize a streaming writer.
+     * The write function gets the given state as first argument
+     * and returns a negative status code on error.
+     *
+     * @param[out] writer the writer
+     * @param[in] write the function writing staged bytes to the sink
+     * @param[in] state the state of the sink
+     */
+    void urdflib_writer_init(urdflib_writer_t *writer, int (*write)(void *state, const uint8_t *data, size_t size), void *state);
+
+    /**
+     * Start writing a graph (anonymous if name is NULL).
+     *
+     * @param[inout] writer the writer
+     * @param[in] name the graph name represented as a CURIE, or NULL
+     * @return a status code
+     */
+    int urdflib_write_graph_start(urdflib_writer_t *writer, const urdflib_t *name);
+
+    /**
+     * Write a triple of the graph.
+     * Triples sharing a subject must be written consecutively,
+     * and so must triples sharing a subject and a predicate.
+     * The encoding is then the same as with urdflib_add_triple().
+     *
+     * @param[inout] writer the writer
+     * @param[in] s the subject of the triple
+     * @param[in] p the predicate of the triple
+     * @param[in] o the object of the triple
+     * @return a status code (STATUS_BUFFER_ERROR if p and o do not fit in URDFLIB_WRITER_SIZE)
+     */
+    int urdflib_write_triple(urdflib_writer_t *writer, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o);
+
+    /**
+     * End the graph and flush all staged bytes.
+     *
+     * @param[inout] writer the writer
+     * @return a status code
+     */
+    int urdflib_write_graph_end(urdflib_writer_t *writer);
+
+    /**
+     * Merge graphs a and b into a new graph holding the union of their triples (named as a).
+     * Nodes are copied as encoded byte ranges:
+     * nodes of a subject found in both graphs are merged pair by pair
+     * (values of b already found in a are not copied again,
+     * pairs whose values were all removed are dropped).
+     * Blank nodes of b whose identifier is also used in a are renamed,
+     * so that blank nodes of both graphs remain distinct: identifiers
+     * above UINT64_MAX / 2 are rejected (STATUS_ARG_ERROR) for renamed ones not to overflow.
+     *
+     * If nodes of both graphs are sorted by subject (in bytewise order of their encoding),
+     * they are merged in order and out is sorted as well.
+     * Otherwise, out holds the nodes of a then the other nodes of b,
+     * subjects being looked up through indexes (or directories) of a and b.
+     * Either way, each input is scanned twice: once for its blank nodes
+     * and the order of its subjects, then to be merged.
+     *
+     * @param[in] a a graph
+     * @param[in] b another graph
+     * @param[out] out the merged graph, to be released with urdflib_delete
+     * @return a status code
+     */
+    int urdflib_graph_merge(const urdflib_t *a, const urdflib_t *b, urdflib_t *out);
+
+    /**
+     * Build a dictionary from a vocabulary given as text (e.g. the content of a file).
+     * Each line maps an IRI (optionally between angle brackets) to a term index
+     * or to a CURIE given as ns_id:local_id, e.g.:
+     *
+     *     https://saref.etsi.org/core/Observation 15
+     *     <https://saref.etsi.org/core/madeBy> 8:16
+     *
+     * Empty lines and lines starting with # are ignored.
+     * The text can be released once the dictionary is built.
+     *
+     * @param[out] dict the dictionary, to be released with urdflib_dict_delete
+     * @param[in] text the vocabulary
+     * @param[in] len the length of the text
+     * @return a status code (STATUS_ARG_ERROR if a line is invalid or an IRI or term is given twice)
+     */
+    int urdflib_dict_parse(urdflib_dict_t *dict, const char *text, size_t len);
+
+#ifndef URDFLIB_NO_FILES
+    /**
+     * Build a dictionary from a vocabulary file (see urdflib_dict_parse).
+     *
+     * @param[out] dict the dictionary, to be released with urdflib_dict_delete
+     * @param[in] path the path of the file
+     * @return a status code
+     */
+    int urdflib_dict_load(urdflib_dict_t *dict, const char *path);
+
+    /**
+     * Write a dictionary as C source defining a constant urdflib_dict_t,
+     * to be compiled (e.g. into flash memory) instead of building the dictionary at run time.
+     *
+     * @param[in] dict the dictionary
+     * @param[in] path the path of the C file
+     * @param[in] name the name of the variable
+     * @return a status code
+     */
+    int urdflib_dict_write_c(const urdflib_dict_t *dict, const char *path, const char *name);
+#endif
+
+    /**
+     * Release the memory of a dictionary built at run time.
+     *
+     * @param[inout] dict the dictionary
+     */
+    void urdflib_dict_delete(urdflib_dict_t *dict);
+
+    /**
+     * Find the term of an IRI in O(1).
+     *
+     * @param[in] dict the dictionary
+     * @param[in] iri the IRI
+     * @param[in] len the length of the IRI
+     * @param[out] term the term (pointing into the dictionary)
+     * @return a status code (STATUS_NO_ITEM if the IRI is unknown)
+     */
+    int urdflib_dict_find_term(const urdflib_dict_t *dict, const char *iri, size_t len, urdflib_t *term);
+
+    /**
+     * Find the IRI of a term in O(1).
+     *
+     * @param[in] dict the dictionary
+     * @param[in] term a term index or CURIE
+     * @param[out] iri the IRI (pointing into the dictionary, not null-terminated)
+     * @param[out] len the length of the IRI
+     * @return a status code (STATUS_NO_ITEM if the term is unknown)
+     */
+    int urdflib_dict_find_iri(const urdflib_dict_t *dict, const urdflib_t *term, const char **iri, size_t *len);
+
+    /**
+     * Find the next solution of graph pattern q (a graph whose terms may be variables)
+     * in graph g, as a mapping from variables to terms of g.
+     * Triple patterns are joined most selective first (bound subject, then bound object),
+     * subjects being looked up in the subject index of g or in an index built once per evaluation.
+     * Variable indexes must be below URDFLIB_ID_MAX (STATUS_ARG_ERROR otherwise).
+     * Mappings are arrays indexed by variable, so their size follows the largest variable index,
+     * whereas the evaluation state only grows with the number of distinct variables.
+     * The evaluation state is kept in ctx, which must be zero-initialized before the first call.
+     * It is released when the last mapping has been found (or on error),
+     * or by urdflib_ctx_delete if the evaluation is abandoned before.
+     *
+     * @param[in] g the graph
+     * @param[in,out] ctx the context of the search
+     * @param[in] q the graph pattern
+     * @param[out] mu the mapping found (see urdflib_create_mapping)
+     * @return a status code
+     */
     int urdflib_find_next_mapping(const urdflib_t *g, urdflib_ctx_t *ctx, urdflib_t *q, urdflib_t *mu);
 
+    /**
+     * Build the tape of graph g in a single pass over its buffer:
+     * an array holding, for each node, pair and term, its offset and size in g
+     * (or the number of entries it spans, to skip it at once),
+     * followed by a hash index of subjects.
+     * Removed triples are left out. The tape points to the buffer of g,
+     * and must be rebuilt if g is modified (it is meant for frozen graphs).
+     *
+     * @param[in] g the graph
+     * @param[out] tape the tape, to be released with urdflib_tape_delete
+     * @return a status code
+     */
+    int urdflib_tape_build(const urdflib_t *g, urdflib_tape_t *tape);
+
+    /**
+     * Release the memory of a tape (the graph itself is left untouched).
+     *
+     * @param[in] tape the tape
+     */
+    void urdflib_tape_delete(urdflib_tape_t *tape);
+
+    /**
+     * Find the next triple matching s, p and o (NULL for any term) in the graph of a tape,
+     * as urdflib_find_triples does but without decoding the graph:
+     * a bound subject is looked up in the index of the tape
+     * and pairs whose key differs from a bound predicate are skipped at once.
+     *
+     * @param[in] tape the tape
+     * @param[in,out] ctx the context of the search (zero-initialized before the first call)
+     * @param[in] s the subject to match, or NULL
+     * @param[in] p the predicate to match, or NULL
+     * @param[in] o the object to match, or NULL
+     * @param[out] s_out the subject of the next triple found (may be NULL)
+     * @param[out] p_out the predicate of the next triple found (may be NULL)
+     * @param[out] o_out the object of the next triple found (may be NULL)
+     * @return a status code
+     */
+    int urdflib_tape_find_triples(const urdflib_tape_t *tape, urdflib_ctx_t *ctx,
+                                  const urdflib_t *s, const urdflib_t *p, const urdflib_t *o,
+                                  urdflib_t *s_out, urdflib_t *p_out, urdflib_t *o_out);
+
+    /**
+     * Find the next solution of graph pattern q in the graph of a tape
+     * (see urdflib_find_next_mapping), triple patterns being matched on the tape.
+     *
+     * @param[in] tape the tape
+     * @param[in,out] ctx the context of the search
+     * @param[in] q the graph pattern
+     * @param[out] mu the mapping found (see urdflib_create_mapping)
+     * @return a status code
+     */
+    int urdflib_tape_find_next_mapping(const urdflib_tape_t *tape, urdflib_ctx_t *ctx, urdflib_t *q, urdflib_t *mu);
+
+    /**
+     * Create an empty mapping, to be filled by urdflib_find_next_mapping.
+     * A mapping is encoded as an array of terms indexed by variable
+     * (undefined for unbound variables).
+     */
+    urdflib_t urdflib_create_mapping();
+
+    /**
+     * Get the term bound to a variable in a mapping.
+     *
+     * @param[in] mu the mapping
+     * @param[in] var_idx the index of the variable
+     * @param[out] val the term bound to the variable (pointing into mu)
+     * @return a status code (STATUS_NO_ITEM if the variable is unbound)
+     */
+    int urdflib_get_binding(const urdflib_t *mu, urdflib_id_t var_idx, urdflib_t *val);
+
+    /**
+     * Release the state of a pattern matching kept in a search context.
+     *
+     * @param[in,out] ctx the context of the search
+     */
+    void urdflib_ctx_delete(urdflib_ctx_t *ctx);
+
 #endif
 
 #ifdef __cplusplus
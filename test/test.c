@@ -40,6 +40,34 @@ void test_create_uriref_curie()
     TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &actual));
 }
 
+void test_create_wide_ids()
+{
+    urdflib_t max_id = urdflib_create_uriref(URDFLIB_ID_MAX);
+
+    // ids are encoded as the shortest CBOR unsigned integer
+    TEST_ASSERT_EQUAL(URDFLIB_ID_MAX > UINT16_MAX ? 5 : 3, max_id.size);
+    urdflib_delete(&max_id);
+
+    // URDFLIB_ID_MAX is reserved for terms of triple patterns that are not variables
+    urdflib_t reserved_var = urdflib_create_variable(URDFLIB_ID_MAX);
+    TEST_ASSERT_NULL(reserved_var.buffer);
+    TEST_ASSERT_EQUAL(0, reserved_var.size);
+
+#ifdef URDFLIB_WIDE_IDS
+    uint8_t b[10] = {0xD9, 0x01, 0x40, 0x82, 0x1A, 0x00, 0x01, 0x11, 0x70, 0x07};
+    urdflib_t expected = {.buffer = b, .size = 10, .type = TYPE_URIREF};
+    urdflib_t curie = urdflib_create_uriref_curie(70000, 7);
+    urdflib_t var = urdflib_create_variable(70000);
+
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &curie));
+    TEST_ASSERT_EQUAL(8, var.size);
+    TEST_ASSERT_EQUAL_MEMORY(b + 4, var.buffer + 3, 5);
+
+    urdflib_delete(&curie);
+    urdflib_delete(&var);
+#endif
+}
+
 void test_create_bnode()
 {
     uint8_t b[4] = {0xD9, 0x07, 0xE4, 0x00};
@@ -52,6 +80,33 @@ void test_create_bnode()
     TEST_ASSERT_EQUAL(0, urdflib_cmp(&actual, &actual_other) == 0);
 }
 
+void test_create_bnode_with()
+{
+    uint8_t b[8] = {0xD9, 0x07, 0xE4, 0x1A, 0x00, 0x01, 0x11, 0x70};
+    urdflib_t expected = {.buffer = b, .size = 8, .type = TYPE_BNODE};
+    urdflib_bnode_gen_t gen, other_gen;
+    urdflib_t actual, other;
+
+    // identifiers wider than 16 bits
+    urdflib_bnode_gen_init(&gen, 70000);
+    actual = urdflib_create_bnode_with(&gen);
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &actual));
+    urdflib_delete(&actual);
+
+    actual = urdflib_create_bnode_with(&gen);
+    TEST_ASSERT_EQUAL(70001, gen.next - 1);
+    TEST_ASSERT_EQUAL(8, actual.size);
+
+    // generators are independent, identifiers in the shortest form
+    urdflib_bnode_gen_init(&other_gen, 0);
+    other = urdflib_create_bnode_with(&other_gen);
+    TEST_ASSERT_EQUAL(4, other.size);
+    TEST_ASSERT_EQUAL(0x00, other.buffer[3]);
+
+    urdflib_delete(&other);
+    urdflib_delete(&actual);
+}
+
 void test_create_literal()
 {
     uint8_t b[5] = {0x64, 0x70, 0x6C, 0x6F, 0x70};
@@ -89,6 +144,42 @@ void test_create_typed_literal()
     TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &actual));
 }
 
+void test_create_long_literal()
+{
+    const char *str = "4ET_429_sensor1_CO2_sensor";
+    urdflib_t actual = urdflib_create_literal(str);
+
+    TEST_ASSERT_EQUAL(28, actual.size);
+    TEST_ASSERT_EQUAL(0x78, actual.buffer[0]);
+    TEST_ASSERT_EQUAL(26, actual.buffer[1]);
+    TEST_ASSERT_EQUAL(0, memcmp(actual.buffer + 2, str, 26));
+
+    urdflib_delete(&actual);
+}
+
+void test_init_terms()
+{
+    uint8_t buf[URDFLIB_TERM_SIZE];
+    uint8_t small[2];
+    urdflib_t expected = urdflib_create_uriref_curie(0, 300);
+    urdflib_t actual;
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_init_uriref_curie(&actual, buf, URDFLIB_TERM_SIZE, 0, 300));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &actual));
+    TEST_ASSERT_EQUAL(0, actual.capacity);
+
+    // not owned: nothing freed
+    urdflib_delete(&actual);
+
+    TEST_ASSERT_EQUAL(STATUS_BUFFER_ERROR, urdflib_init_literal_float(&actual, small, 2, 3.14));
+    TEST_ASSERT_NULL(actual.buffer);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_init_literal(&actual, buf, URDFLIB_TERM_SIZE, "plop"));
+    TEST_ASSERT_EQUAL(5, actual.size);
+
+    urdflib_delete(&expected);
+}
+
 void test_create_graph()
 {
     uint8_t b[5] = {0xBF, 0x01, 0x9F, 0xFF, 0xFF};
@@ -198,6 +289,384 @@ void test_add_tree()
     TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &actual));
 }
 
+void test_add_multiple_values()
+{
+    uint8_t b[22] = {0xBF, 0x01, 0x9F, 0xBF, 0x00, 0xD9, 0x01, 0x40, 0x82, 0x00, 0x00, 0x06, 0x9F, 0x07, 0x0A, 0x0B, 0xFF, 0x08, 0x09, 0xFF, 0xFF, 0xFF};
+    urdflib_t expected = {.buffer = b, .size = 22, .type = TYPE_GRAPH};
+    urdflib_t s = urdflib_create_uriref_curie(0, 0);
+    urdflib_t p1 = urdflib_create_uriref(6);
+    urdflib_t o1 = urdflib_create_uriref(7);
+    urdflib_t p2 = urdflib_create_uriref(8);
+    urdflib_t o2 = urdflib_create_uriref(9);
+    urdflib_t o3 = urdflib_create_uriref(10);
+    urdflib_t o4 = urdflib_create_uriref(11);
+    urdflib_t actual = urdflib_create_graph();
+    urdflib_t bulk = urdflib_create_graph();
+    const urdflib_t triples[4][3] = {{s, p1, o1}, {s, p2, o2}, {s, p1, o3}, {s, p1, o4}};
+    urdflib_t actual_s, actual_p, actual_o;
+    urdflib_ctx_t ctx;
+    int status;
+    uint8_t actual_count = 0;
+
+    urdflib_add_triple(&actual, &s, &p1, &o1);
+    urdflib_add_triple(&actual, &s, &p2, &o2);
+    urdflib_add_triple(&actual, &s, &p1, &o3);
+    urdflib_add_triple(&actual, &s, &p1, &o4);
+    urdflib_freeze(&actual);
+
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &actual));
+
+    urdflib_add_triples(&bulk, triples, 4);
+    urdflib_freeze(&bulk);
+
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &bulk));
+
+    ctx.idx = 0;
+    ctx.key_idx = 0;
+    ctx.node_idx = 0;
+
+    do
+    {
+        status = urdflib_find_next_triple(&actual, &ctx, &actual_s, &actual_p, &actual_o);
+        if (status == STATUS_OK)
+            actual_count++;
+
+        if (actual_count == 3)
+        {
+            TEST_ASSERT_EQUAL(0, urdflib_cmp(&s, &actual_s));
+            TEST_ASSERT_EQUAL(0, urdflib_cmp(&p1, &actual_p));
+            TEST_ASSERT_EQUAL(0, urdflib_cmp(&o4, &actual_o));
+        }
+    } while (status == STATUS_OK);
+
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, status);
+    TEST_ASSERT_EQUAL(4, actual_count);
+
+    urdflib_delete(&actual);
+    urdflib_delete(&bulk);
+}
+
+void test_add_unique_triples()
+{
+    urdflib_t g = urdflib_create_graph();
+    urdflib_t sensor = urdflib_create_uriref_curie(1, 2);
+    urdflib_t observes = urdflib_create_uriref(12);
+    urdflib_t o1 = urdflib_create_literal("temperature");
+    urdflib_t o2 = urdflib_create_literal("humidity");
+    size_t size;
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_triple_with(&g, &sensor, &observes, &o1, URDFLIB_ADD_UNIQUE));
+    size = g.size;
+    TEST_ASSERT_EQUAL(STATUS_EXISTS, urdflib_add_triple_with(&g, &sensor, &observes, &o1, URDFLIB_ADD_UNIQUE));
+    TEST_ASSERT_EQUAL(size, g.size);
+
+    // values of an array are searched as well
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_triple_with(&g, &sensor, &observes, &o2, URDFLIB_ADD_UNIQUE));
+    size = g.size;
+    TEST_ASSERT_EQUAL(STATUS_EXISTS, urdflib_add_triple_with(&g, &sensor, &observes, &o1, URDFLIB_ADD_UNIQUE));
+    TEST_ASSERT_EQUAL(STATUS_EXISTS, urdflib_add_triple_with(&g, &sensor, &observes, &o2, URDFLIB_ADD_UNIQUE));
+    TEST_ASSERT_EQUAL(size, g.size);
+
+    // the directory of a frozen graph is kept if nothing is added
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_freeze_with(&g, URDFLIB_FREEZE_DIRECTORY));
+    size = g.size;
+    TEST_ASSERT_EQUAL(STATUS_EXISTS, urdflib_add_triple_with(&g, &sensor, &observes, &o2, URDFLIB_ADD_UNIQUE));
+    TEST_ASSERT_EQUAL(size, g.size);
+
+    // without the option, duplicates are added
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_triple(&g, &sensor, &observes, &o2));
+    TEST_ASSERT_TRUE(g.size != size);
+
+    urdflib_delete(&g);
+    urdflib_delete(&sensor);
+    urdflib_delete(&observes);
+    urdflib_delete(&o1);
+    urdflib_delete(&o2);
+}
+
+void test_remove_triples()
+{
+    urdflib_t g = urdflib_create_graph();
+    urdflib_t expected = urdflib_create_graph();
+    urdflib_t other = urdflib_create_graph();
+    urdflib_t h = urdflib_create_graph();
+    urdflib_t merged, long_literal;
+    char long_str[400];
+    int status;
+    urdflib_t s1 = urdflib_create_uriref_curie(1, 2);
+    urdflib_t s2 = urdflib_create_uriref(8);
+    urdflib_t p1 = urdflib_create_uriref(6);
+    urdflib_t p2 = urdflib_create_uriref(9);
+    urdflib_t o1 = urdflib_create_uriref(7);
+    urdflib_t o2 = urdflib_create_literal("relative humidity, in percent of saturation");
+    urdflib_t o3 = urdflib_create_uriref(10);
+    urdflib_t s, p, o;
+    urdflib_ctx_t ctx;
+    urdflib_parser_t parser;
+    uint8_t b[8] = {0xBF, 0x01, 0x9F, 0xBF, 0x00, 0x08, 0xFF, 0xFF};
+    urdflib_t not_owned = {.buffer = b, .size = 8, .type = TYPE_GRAPH};
+    size_t size, count;
+
+    urdflib_add_triple(&g, &s1, &p1, &o1);
+    urdflib_add_triple(&g, &s1, &p1, &o2);
+    urdflib_add_triple(&g, &s1, &p2, &o3);
+    urdflib_add_triple(&g, &s2, &p2, &o3);
+    size = g.size;
+
+    // removed in place
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_remove_triple(&g, &s1, &p1, &o2));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_remove_triple(&g, &s1, &p1, &o2));
+    TEST_ASSERT_EQUAL(size, g.size);
+    TEST_ASSERT_EQUAL(o2.size, g.removed_size);
+
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&g, &ctx, &s1, &p1, NULL, NULL, NULL, &o));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&o1, &o));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_triples(&g, &ctx, &s1, &p1, NULL, NULL, NULL, &o));
+
+    // pattern with wildcards: single values are removed with their key
+    TEST_ASSERT_EQUAL(2, urdflib_remove_triples(&g, NULL, &p2, &o3));
+    TEST_ASSERT_EQUAL(0, urdflib_remove_triples(&g, NULL, &p2, NULL));
+
+    // added after removal
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_triple(&g, &s2, &p1, &o2));
+
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    count = 0;
+    while (urdflib_find_next_triple(&g, &ctx, &s, &p, &o) == STATUS_OK)
+        count++;
+    TEST_ASSERT_EQUAL(2, count);
+
+    // removed triples are skipped by the parser as well
+    urdflib_parser_init(&parser);
+    urdflib_parser_feed(&parser, g.buffer, g.size);
+    count = 0;
+    while (urdflib_parser_next(&parser, &s, &p, &o) == STATUS_OK)
+        count++;
+    TEST_ASSERT_EQUAL(2, count);
+
+    // removed terms larger than the parser's buffer, skipped across chunks
+    memset(long_str, 'a', sizeof(long_str) - 1);
+    long_str[sizeof(long_str) - 1] = '\0';
+    long_literal = urdflib_create_literal(long_str);
+    urdflib_add_triple(&h, &s1, &p1, &long_literal);
+    urdflib_add_triple(&h, &s1, &p1, &o1);
+    urdflib_add_triple(&h, &s2, &p2, &long_literal);
+    TEST_ASSERT_EQUAL(2, urdflib_remove_triples(&h, NULL, NULL, &long_literal));
+
+    for (size_t chunk_size = 1; chunk_size <= h.size; chunk_size += 50)
+    {
+        urdflib_parser_init(&parser);
+        count = 0;
+        status = STATUS_NEED_INPUT;
+
+        for (size_t i = 0; i < h.size && status == STATUS_NEED_INPUT; i += chunk_size)
+        {
+            urdflib_parser_feed(&parser, h.buffer + i, i + chunk_size < h.size ? chunk_size : h.size - i);
+            while ((status = urdflib_parser_next(&parser, &s, &p, &o)) == STATUS_OK)
+                count++;
+        }
+
+        TEST_ASSERT_EQUAL(STATUS_NO_ITEM, status);
+        TEST_ASSERT_EQUAL(1, count);
+    }
+
+    // merged nodes drop tombstones, copied nodes keep them
+    urdflib_add_triple(&other, &s1, &p1, &o1);
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_graph_merge(&g, &other, &merged));
+    TEST_ASSERT_EQUAL(p2.size + o3.size, merged.removed_size);
+    urdflib_delete(&merged);
+    urdflib_delete(&other);
+
+    // compacted as if never added
+    urdflib_add_triple(&expected, &s1, &p1, &o1);
+    urdflib_add_triple(&expected, &s2, &p1, &o2);
+
+    size = g.size;
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_compact(&g));
+    TEST_ASSERT_TRUE(g.size < size);
+    TEST_ASSERT_EQUAL(0, g.removed_size);
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &g));
+
+    urdflib_add_triple(&g, &s2, &p2, &o3);
+    urdflib_add_triple(&expected, &s2, &p2, &o3);
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &g));
+
+    // compacted by freeze, the directory being rebuilt
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_freeze_with(&g, URDFLIB_FREEZE_DIRECTORY));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_remove_triple(&g, &s1, &p1, &o1));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_freeze_with(&g, URDFLIB_FREEZE_DIRECTORY));
+
+    urdflib_delete(&expected);
+    expected = urdflib_create_graph();
+    urdflib_add_triple(&expected, &s2, &p1, &o2);
+    urdflib_add_triple(&expected, &s2, &p2, &o3);
+    urdflib_freeze_with(&expected, URDFLIB_FREEZE_DIRECTORY);
+    TEST_ASSERT_EQUAL(expected.size, g.size);
+    TEST_ASSERT_EQUAL_MEMORY(expected.buffer, g.buffer, g.size);
+
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_triples(&g, &ctx, &s1, NULL, NULL, NULL, NULL, NULL));
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&g, &ctx, &s2, &p2, NULL, NULL, NULL, &o));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&o3, &o));
+
+    // buffer not owned by uRDFLib
+    TEST_ASSERT_EQUAL(STATUS_BUFFER_ERROR, urdflib_remove_triples(&not_owned, NULL, NULL, NULL));
+
+    urdflib_delete(&h);
+    urdflib_delete(&long_literal);
+    urdflib_delete(&g);
+    urdflib_delete(&expected);
+    urdflib_delete(&s1);
+    urdflib_delete(&s2);
+    urdflib_delete(&p1);
+    urdflib_delete(&p2);
+    urdflib_delete(&o1);
+    urdflib_delete(&o2);
+    urdflib_delete(&o3);
+}
+
+void test_add_interleaved_triples()
+{
+    uint8_t b[26] = {0xBF, 0x01, 0x9F, 0xBF, 0x00, 0xD9, 0x01, 0x40, 0x82, 0x00, 0x00, 0x06, 0x07, 0x0B, 0x0C, 0x0D, 0x0E, 0xFF, 0xBF, 0x00, 0x08, 0x09, 0x0A, 0xFF, 0xFF, 0xFF};
+    urdflib_t expected = {.buffer = b, .size = 26, .type = TYPE_GRAPH};
+    urdflib_t s1 = urdflib_create_uriref_curie(0, 0);
+    urdflib_t s2 = urdflib_create_uriref(8);
+    urdflib_t p1 = urdflib_create_uriref(6);
+    urdflib_t o1 = urdflib_create_uriref(7);
+    urdflib_t p2 = urdflib_create_uriref(9);
+    urdflib_t o2 = urdflib_create_uriref(10);
+    urdflib_t p3 = urdflib_create_uriref(11);
+    urdflib_t o3 = urdflib_create_uriref(12);
+    urdflib_t p4 = urdflib_create_uriref(13);
+    urdflib_t o4 = urdflib_create_uriref(14);
+    urdflib_t actual = urdflib_create_graph();
+
+    urdflib_add_triple(&actual, &s1, &p1, &o1);
+    urdflib_add_triple(&actual, &s2, &p2, &o2);
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_triple(&actual, &s1, &p3, &o3));
+    urdflib_freeze(&actual);
+    // subject index rebuilt after freeze
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_triple(&actual, &s1, &p4, &o4));
+    urdflib_freeze(&actual);
+
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &actual));
+
+    urdflib_delete(&actual);
+}
+
+void test_add_many_triples()
+{
+    urdflib_t p1 = urdflib_create_uriref(6);
+    urdflib_t p2 = urdflib_create_uriref(7);
+    urdflib_t o = urdflib_create_literal_float(3.14);
+    urdflib_t g = urdflib_create_graph();
+    urdflib_t s, p, actual_o;
+    urdflib_ctx_t ctx;
+    int status;
+    uint16_t expected_count = 1000;
+    uint16_t actual_count = 0;
+
+    for (uint16_t i = 0; i < expected_count / 2; i++)
+    {
+        s = urdflib_create_uriref_curie(1, i);
+
+        TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_triple(&g, &s, &p1, &o));
+        TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_triple(&g, &s, &p2, &o));
+
+        urdflib_delete(&s);
+    }
+
+    TEST_ASSERT_TRUE(g.size > 512);
+    TEST_ASSERT_TRUE(g.capacity >= g.size);
+
+    urdflib_freeze(&g);
+
+    TEST_ASSERT_EQUAL(g.size, g.capacity);
+
+    ctx.idx = 0;
+    ctx.key_idx = 0;
+    ctx.node_idx = 0;
+
+    do
+    {
+        status = urdflib_find_next_triple(&g, &ctx, &s, &p, &actual_o);
+        if (status == STATUS_OK)
+            actual_count++;
+    } while (status == STATUS_OK);
+
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, status);
+    TEST_ASSERT_EQUAL(expected_count, actual_count);
+
+    urdflib_delete(&g);
+}
+
+void test_add_triples_bulk()
+{
+    uint8_t b[47] = {0xBF, 0x01, 0x9F, 0xBF, 0x00, 0xD9, 0x01, 0x40, 0x82, 0x00, 0x00, 0x06, 0xD9, 0x01, 0x40, 0x82, 0x00, 0x01, 0x07, 0x08, 0xFF, 0xBF, 0x00, 0xD9, 0x01, 0x40, 0x82, 0x00, 0x01, 0x09, 0xD9, 0x07, 0xE4, 0x02, 0x0B, 0x0C, 0xFF, 0xBF, 0x00, 0x08, 0x09, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF};
+    uint8_t bnode[4] = {0xD9, 0x07, 0xE4, 0x02};
+    urdflib_t expected = {.buffer = b, .size = 47, .type = TYPE_GRAPH};
+    urdflib_t s1 = urdflib_create_uriref_curie(0, 0);
+    urdflib_t s2 = urdflib_create_uriref_curie(0, 1);
+    urdflib_t s3 = urdflib_create_uriref(8);
+    urdflib_t p1 = urdflib_create_uriref(6);
+    urdflib_t p2 = urdflib_create_uriref(7);
+    urdflib_t p3 = urdflib_create_uriref(9);
+    urdflib_t p4 = urdflib_create_uriref(11);
+    urdflib_t p5 = urdflib_create_uriref(14);
+    urdflib_t o1 = {.buffer = bnode, .size = 4, .type = TYPE_BNODE};
+    urdflib_t o2 = urdflib_create_uriref(12);
+    urdflib_t o3 = urdflib_create_uriref(13);
+    urdflib_t o4 = urdflib_create_uriref(15);
+    urdflib_t actual = urdflib_create_graph();
+
+    // first batch creates nodes, second batch appends to them (not in order)
+    const urdflib_t first[4][3] = {{s1, p1, s2}, {s2, p3, o1}, {s3, p3, o3}, {s1, p2, s3}};
+    const urdflib_t second[2][3] = {{s3, p5, o4}, {s2, p4, o2}};
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_triples(&actual, first, 4));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_triples(&actual, second, 2));
+    urdflib_freeze(&actual);
+
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &actual));
+
+    urdflib_delete(&actual);
+}
+
+void test_arena_graph()
+{
+    uint8_t mem[4096];
+    urdflib_arena_t arena;
+    const urdflib_allocator_t *alloc = urdflib_arena_init(&arena, mem, sizeof(mem));
+    urdflib_t s = urdflib_create_uriref_curie(0, 0);
+    urdflib_t p = urdflib_create_uriref(6);
+    urdflib_t o = urdflib_create_literal("plop");
+    urdflib_t g = urdflib_create_graph_with(NULL, alloc);
+    int status;
+
+    TEST_ASSERT_TRUE(g.buffer >= mem && g.buffer < mem + sizeof(mem));
+
+    // graph buffer grows within the arena until it is exhausted
+    do
+        status = urdflib_add_triple(&g, &s, &p, &o);
+    while (status == STATUS_OK);
+
+    TEST_ASSERT_EQUAL(STATUS_MALLOC_ERROR, status);
+    TEST_ASSERT_TRUE(g.size > 512);
+
+    urdflib_arena_reset(&arena);
+    TEST_ASSERT_EQUAL(0, arena.used);
+
+    g = urdflib_create_graph_with(NULL, alloc);
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_triple(&g, &s, &p, &o));
+    TEST_ASSERT_TRUE(g.buffer >= mem && g.buffer < mem + sizeof(mem));
+
+    urdflib_delete(&s);
+    urdflib_delete(&p);
+    urdflib_delete(&o);
+}
+
 void test_find_next_triple()
 {
     uint8_t b[35] = {0xBF, 0x01, 0x9F, 0xBF, 0x00, 0xD9, 0x01, 0x40, 0x82, 0x00, 0x00, 0x08, 0xC1, 0x1A, 0x65, 0xBA, 0x78, 0xEE, 0x06, 0x07, 0x09, 0xFA, 0x40, 0x48, 0xF5, 0xC3, 0x0A, 0x64, 0x70, 0x6C, 0x6F, 0x70, 0xFF, 0xFF, 0xFF};
@@ -266,6 +735,404 @@ void test_find_in_tree()
     TEST_ASSERT_EQUAL(0, expected_count - actual_count);
 }
 
+void test_find_wide_tokens()
+{
+    uint8_t b[22] = {0xBF, 0x01, 0x9F, 0xBF, 0x00, 0x19, 0x01, 0x63, 0x19, 0x03, 0xE8, 0x64, 0x70, 0x6C, 0x6F, 0x70, 0x18, 0x20, 0x07, 0xFF, 0xFF, 0xFF};
+    urdflib_t g = {.buffer = b, .size = 22, .type = TYPE_GRAPH};
+    urdflib_t expected_s = urdflib_create_uriref(355);
+    urdflib_t expected_p = urdflib_create_uriref(1000);
+    urdflib_t expected_o = urdflib_create_literal("plop");
+    urdflib_t s, p, o;
+    urdflib_ctx_t ctx;
+
+    ctx.idx = 0;
+    ctx.key_idx = 0;
+    ctx.node_idx = 0;
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_next_triple(&g, &ctx, &s, &p, &o));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&s, &expected_s));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&p, &expected_p));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&o, &expected_o));
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_next_triple(&g, &ctx, &s, &p, &o));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_next_triple(&g, &ctx, &s, &p, &o));
+
+    // truncated buffer
+    g.size = 10;
+    ctx.idx = 0;
+    ctx.key_idx = 0;
+    ctx.node_idx = 0;
+
+    TEST_ASSERT_TRUE(urdflib_find_next_triple(&g, &ctx, &s, &p, &o) < STATUS_NO_ITEM);
+}
+
+void test_find_mappings()
+{
+    urdflib_t g = urdflib_create_graph();
+    urdflib_t q = urdflib_create_graph();
+    urdflib_t mu = urdflib_create_mapping();
+    urdflib_t type = urdflib_create_uriref(2);
+    urdflib_t sensor = urdflib_create_uriref(10);
+    urdflib_t actuator = urdflib_create_uriref(11);
+    urdflib_t observes = urdflib_create_uriref(12);
+    urdflib_t s1 = urdflib_create_uriref(100);
+    urdflib_t s2 = urdflib_create_uriref(101);
+    urdflib_t s3 = urdflib_create_uriref(102);
+    urdflib_t p1 = urdflib_create_literal("temperature");
+    urdflib_t p2 = urdflib_create_literal("humidity");
+    urdflib_t x = urdflib_create_variable(0);
+    urdflib_t y = urdflib_create_variable(1);
+    urdflib_t sparse_x = urdflib_create_variable(300);
+    urdflib_t sparse_y = urdflib_create_variable(5);
+    uint8_t b[12] = {0xD9, 0x07, 0xE3, 0x1B, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00};
+    urdflib_t out_of_range = {.buffer = b, .size = 12, .type = TYPE_VARIABLE};
+    urdflib_t val;
+    urdflib_ctx_t ctx = {0};
+
+    urdflib_add_triple(&g, &s1, &observes, &p1);
+    urdflib_add_triple(&g, &s2, &type, &sensor);
+    urdflib_add_triple(&g, &s3, &type, &actuator);
+    urdflib_add_triple(&g, &s2, &observes, &p2);
+    urdflib_add_triple(&g, &s1, &type, &sensor);
+    urdflib_add_triple(&g, &s3, &observes, &p1);
+
+    // ?x observes ?y . ?x type sensor
+    urdflib_add_triple(&q, &x, &observes, &y);
+    urdflib_add_triple(&q, &x, &type, &sensor);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_next_mapping(&g, &ctx, &q, &mu));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_get_binding(&mu, 0, &val));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&val, &s1));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_get_binding(&mu, 1, &val));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&val, &p1));
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_next_mapping(&g, &ctx, &q, &mu));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_get_binding(&mu, 0, &val));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&val, &s2));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_get_binding(&mu, 1, &val));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&val, &p2));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_get_binding(&mu, 2, &val));
+
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_next_mapping(&g, &ctx, &q, &mu));
+    TEST_ASSERT_NULL(ctx.state);
+
+    // abandoned evaluation
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_next_mapping(&g, &ctx, &q, &mu));
+    urdflib_ctx_delete(&ctx);
+    TEST_ASSERT_NULL(ctx.state);
+
+    // sparse variable indexes: ?300 observes ?5
+    urdflib_delete(&q);
+    q = urdflib_create_graph();
+    urdflib_add_triple(&q, &sparse_x, &observes, &sparse_y);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_next_mapping(&g, &ctx, &q, &mu));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_get_binding(&mu, 300, &val));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&val, &s1));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_get_binding(&mu, 5, &val));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&val, &p1));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_get_binding(&mu, 0, &val));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_get_binding(&mu, 301, &val));
+    urdflib_ctx_delete(&ctx);
+
+    // variable index out of the range of urdflib_id_t
+    urdflib_add_triple(&q, &out_of_range, &type, &sensor);
+    TEST_ASSERT_EQUAL(STATUS_ARG_ERROR, urdflib_find_next_mapping(&g, &ctx, &q, &mu));
+    TEST_ASSERT_NULL(ctx.state);
+
+    urdflib_delete(&sparse_x);
+    urdflib_delete(&sparse_y);
+    urdflib_delete(&g);
+    urdflib_delete(&q);
+    urdflib_delete(&mu);
+}
+
+void test_find_triples()
+{
+    urdflib_t g = urdflib_create_graph();
+    urdflib_t type = urdflib_create_uriref(2);
+    urdflib_t sensor = urdflib_create_uriref(10);
+    urdflib_t observes = urdflib_create_uriref(12);
+    urdflib_t s1 = urdflib_create_uriref(100);
+    urdflib_t s2 = urdflib_create_uriref(101);
+    urdflib_t s3 = urdflib_create_uriref(102);
+    urdflib_t p1 = urdflib_create_literal("temperature");
+    urdflib_t p2 = urdflib_create_literal("humidity");
+    urdflib_t s, p, o;
+    urdflib_ctx_t ctx = {0};
+
+    urdflib_add_triple(&g, &s1, &type, &sensor);
+    urdflib_add_triple(&g, &s1, &observes, &p1);
+    urdflib_add_triple(&g, &s1, &observes, &p2);
+    urdflib_add_triple(&g, &s2, &type, &sensor);
+    urdflib_add_triple(&g, &s2, &observes, &p2);
+
+    // all triples about s1
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&g, &ctx, &s1, NULL, NULL, &s, &p, &o));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&s, &s1));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&o, &sensor));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&g, &ctx, &s1, NULL, NULL, &s, &p, &o));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&p, &observes));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&o, &p1));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&g, &ctx, &s1, NULL, NULL, &s, &p, &o));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&o, &p2));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_triples(&g, &ctx, &s1, NULL, NULL, &s, &p, &o));
+
+    // subjects observing p2
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&g, &ctx, NULL, &observes, &p2, &s, NULL, NULL));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&s, &s1));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&g, &ctx, NULL, &observes, &p2, &s, NULL, NULL));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&s, &s2));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_triples(&g, &ctx, NULL, &observes, &p2, &s, NULL, NULL));
+
+    // unknown subject, without subject index
+    urdflib_freeze(&g);
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_triples(&g, &ctx, &s3, NULL, NULL, &s, &p, &o));
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&g, &ctx, &s2, &type, NULL, &s, &p, &o));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&o, &sensor));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_triples(&g, &ctx, &s2, &type, NULL, &s, &p, &o));
+
+    urdflib_delete(&g);
+}
+
+void test_tape()
+{
+    urdflib_t g = urdflib_create_graph();
+    urdflib_t q = urdflib_create_graph();
+    urdflib_t mu = urdflib_create_mapping();
+    urdflib_t mu_tape = urdflib_create_mapping();
+    urdflib_t type = urdflib_create_uriref(2);
+    urdflib_t sensor = urdflib_create_uriref(10);
+    urdflib_t observes = urdflib_create_uriref(12);
+    urdflib_t s1 = urdflib_create_uriref(100);
+    urdflib_t s2 = urdflib_create_uriref(101);
+    urdflib_t s3 = urdflib_create_uriref(102);
+    urdflib_t p1 = urdflib_create_literal("temperature");
+    urdflib_t p2 = urdflib_create_literal("humidity");
+    urdflib_t x = urdflib_create_variable(0);
+    urdflib_t y = urdflib_create_variable(1);
+    const urdflib_t *subjects[4] = {NULL, &s1, &s2, &s3};
+    const urdflib_t *predicates[3] = {NULL, &type, &observes};
+    const urdflib_t *objects[3] = {NULL, &sensor, &p2};
+    urdflib_t s, p, o, expected_s, expected_p, expected_o;
+    urdflib_ctx_t ctx = {0}, tape_ctx = {0};
+    urdflib_tape_t tape;
+    int status;
+
+    urdflib_add_triple(&g, &s1, &type, &sensor);
+    urdflib_add_triple(&g, &s1, &observes, &p1);
+    urdflib_add_triple(&g, &s1, &observes, &p2);
+    urdflib_add_triple(&g, &s2, &type, &sensor);
+    urdflib_add_triple(&g, &s2, &observes, &p2);
+    urdflib_add_triple(&g, &s3, &observes, &p1);
+    urdflib_add_triple(&g, &s3, &observes, &p2);
+
+    // removed triples are left out
+    urdflib_remove_triples(&g, &s3, &observes, NULL);
+    urdflib_remove_triple(&g, &s1, &observes, &p1);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_tape_build(&g, &tape));
+
+    // same triples, in the same order, as found in the graph
+    for (int i = 0; i < 4 * 3 * 3; i++)
+    {
+        memset(&ctx, 0, sizeof(urdflib_ctx_t));
+        memset(&tape_ctx, 0, sizeof(urdflib_ctx_t));
+
+        do
+        {
+            status = urdflib_find_triples(&g, &ctx, subjects[i % 4], predicates[i / 4 % 3], objects[i / 12],
+                                          &expected_s, &expected_p, &expected_o);
+            TEST_ASSERT_EQUAL(status, urdflib_tape_find_triples(&tape, &tape_ctx, subjects[i % 4], predicates[i / 4 % 3],
+                                                                objects[i / 12], &s, &p, &o));
+            if (status == STATUS_OK)
+            {
+                TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected_s, &s));
+                TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected_p, &p));
+                TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected_o, &o));
+            }
+        } while (status == STATUS_OK);
+    }
+
+#ifdef URDFLIB_STATS
+    urdflib_stats_t stats;
+
+    // no CBOR token decoded
+    urdflib_stats_reset();
+    memset(&tape_ctx, 0, sizeof(urdflib_ctx_t));
+    while (urdflib_tape_find_triples(&tape, &tape_ctx, NULL, NULL, NULL, &s, &p, &o) == STATUS_OK)
+        ;
+    urdflib_stats_get(&stats);
+    TEST_ASSERT_EQUAL(0, stats.tokens_decoded);
+#endif
+
+    // ?x observes ?y . ?x type sensor
+    urdflib_add_triple(&q, &x, &observes, &y);
+    urdflib_add_triple(&q, &x, &type, &sensor);
+
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    memset(&tape_ctx, 0, sizeof(urdflib_ctx_t));
+
+    do
+    {
+        status = urdflib_find_next_mapping(&g, &ctx, &q, &mu);
+        TEST_ASSERT_EQUAL(status, urdflib_tape_find_next_mapping(&tape, &tape_ctx, &q, &mu_tape));
+        if (status == STATUS_OK)
+        {
+            TEST_ASSERT_EQUAL(mu.size, mu_tape.size);
+            TEST_ASSERT_EQUAL_MEMORY(mu.buffer, mu_tape.buffer, mu.size);
+        }
+    } while (status == STATUS_OK);
+
+    urdflib_tape_delete(&tape);
+    TEST_ASSERT_EQUAL(STATUS_ARG_ERROR, urdflib_tape_find_triples(&tape, &tape_ctx, NULL, NULL, NULL, &s, &p, &o));
+
+    urdflib_delete(&g);
+    urdflib_delete(&q);
+    urdflib_delete(&mu);
+    urdflib_delete(&mu_tape);
+}
+
+void test_freeze_directory()
+{
+    urdflib_t g = urdflib_create_graph();
+    urdflib_t observes = urdflib_create_uriref(12);
+    urdflib_t o = urdflib_create_literal("temperature");
+    urdflib_t s, p, val, subject, unknown = urdflib_create_uriref(5000);
+    urdflib_ctx_t ctx = {0};
+    size_t graph_size;
+    int count = 0;
+
+    for (uint16_t i = 0; i < 1000; i++)
+    {
+        subject = urdflib_create_uriref_curie(1, i);
+        urdflib_add_triple(&g, &subject, &observes, &o);
+        urdflib_delete(&subject);
+    }
+
+    graph_size = g.size;
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_freeze_with(&g, URDFLIB_FREEZE_DIRECTORY));
+#ifdef URDFLIB_WIDE_OFFSETS
+    TEST_ASSERT_EQUAL(graph_size + 13 + 12 * 1000 + 9, g.size);
+#else
+    TEST_ASSERT_EQUAL(graph_size + 9 + 8 * 1000 + 5, g.size);
+#endif
+
+    // readers ignoring the directory stop at the end of the graph
+    while (urdflib_find_next_triple(&g, &ctx, &s, &p, &val) == STATUS_OK)
+        count++;
+    TEST_ASSERT_EQUAL(1000, count);
+
+    for (uint16_t i = 0; i < 1000; i += 7)
+    {
+        subject = urdflib_create_uriref_curie(1, i);
+        memset(&ctx, 0, sizeof(urdflib_ctx_t));
+        TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&g, &ctx, &subject, NULL, NULL, &s, &p, &val));
+        TEST_ASSERT_EQUAL(0, urdflib_cmp(&s, &subject));
+        TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_triples(&g, &ctx, &subject, NULL, NULL, &s, &p, &val));
+        urdflib_delete(&subject);
+    }
+
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_triples(&g, &ctx, &unknown, NULL, NULL, &s, &p, &val));
+
+    // the directory is dropped when the graph is modified
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_triple(&g, &unknown, &observes, &o));
+    TEST_ASSERT_EQUAL(graph_size + 1 + unknown.size + observes.size + o.size + 2, g.size);
+
+    urdflib_delete(&g);
+}
+
+/**
+ * Callback counting the triples of a thread, failing on literals.
+ */
+int check_triple(void *state, const urdflib_t *s, const urdflib_t *p, const urdflib_t *o)
+{
+    size_t *count = state;
+
+    (void)s;
+    (void)p;
+
+    (*count)++;
+    if (o->type == TYPE_LITERAL)
+        return STATUS_BUFFER_ERROR;
+
+    return STATUS_OK;
+}
+
+void test_scan_parallel()
+{
+    urdflib_t g = urdflib_create_graph();
+    urdflib_t p1 = urdflib_create_uriref(12);
+    urdflib_t p2 = urdflib_create_uriref(13);
+    urdflib_t subject, o, bad;
+    urdflib_range_t ranges[16];
+    size_t counts[4] = {0};
+    void *states[4] = {&counts[0], &counts[1], &counts[2], &counts[3]};
+    size_t count;
+    int n;
+
+    for (uint16_t i = 0; i < 3000; i++)
+    {
+        subject = urdflib_create_uriref_curie(1, 1000 + i);
+        o = urdflib_create_uriref_curie(2, 1000 + i);
+        urdflib_add_triple(&g, &subject, &p1, &o);
+        if (i % 3 == 0)
+            urdflib_add_triple(&g, &subject, &p2, &o);
+        urdflib_delete(&subject);
+        urdflib_delete(&o);
+    }
+
+    // ranges of whole nodes, from a pre-pass, the subject index or the directory
+    for (int k = 0; k < 3; k++)
+    {
+        if (k == 1)
+            urdflib_add_triple(&g, &p1, &p1, &p1);
+        if (k == 2)
+            urdflib_freeze_with(&g, URDFLIB_FREEZE_DIRECTORY);
+
+        n = urdflib_split_graph(&g, ranges, 16);
+        TEST_ASSERT_EQUAL(16, n);
+        TEST_ASSERT_EQUAL(3, ranges[0].start);
+        for (int i = 1; i < n; i++)
+        {
+            TEST_ASSERT_EQUAL(ranges[i - 1].end, ranges[i].start);
+            TEST_ASSERT_EQUAL(0xBF, g.buffer[ranges[i].start]);
+        }
+        TEST_ASSERT_EQUAL(0xFF, g.buffer[ranges[n - 1].end]);
+    }
+
+    TEST_ASSERT_EQUAL(1, urdflib_split_graph(&g, ranges, 1));
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_count_triples(&g, NULL, NULL, NULL, 4, &count));
+    TEST_ASSERT_EQUAL(4001, count);
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_count_triples(&g, NULL, &p2, NULL, 3, &count));
+    TEST_ASSERT_EQUAL(1000, count);
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_count_triples(&g, &p1, NULL, NULL, 4, &count));
+    TEST_ASSERT_EQUAL(1, count);
+
+    // per-thread results
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_scan_parallel(&g, NULL, &p1, NULL, check_triple, states, 4));
+    TEST_ASSERT_EQUAL(3001, counts[0] + counts[1] + counts[2] + counts[3]);
+
+    // the first error stops all threads
+    bad = urdflib_create_literal("bad");
+    subject = urdflib_create_uriref_curie(1, 2500);
+    urdflib_add_triple(&g, &subject, &p2, &bad);
+    urdflib_delete(&subject);
+    memset(counts, 0, sizeof(counts));
+    TEST_ASSERT_EQUAL(STATUS_BUFFER_ERROR, urdflib_scan_parallel(&g, NULL, &p2, NULL, check_triple, states, 4));
+    TEST_ASSERT_TRUE(counts[0] + counts[1] + counts[2] + counts[3] <= 1001);
+
+    urdflib_delete(&g);
+    urdflib_delete(&p1);
+    urdflib_delete(&p2);
+    urdflib_delete(&bad);
+}
+
 void setUp()
 {
     // nothing to do
@@ -276,19 +1143,587 @@ void tearDown()
     // nothing to do
 }
 
+void test_freeze_sorted()
+{
+    urdflib_t g = urdflib_create_graph();
+    urdflib_t h = urdflib_create_graph();
+    urdflib_t terms[6], prev_s, prev_p, s, p, val;
+    urdflib_t literal = urdflib_create_literal("a");
+    urdflib_ctx_t ctx = {0};
+    int count = 0;
+    int order[8][3] = {{3, 1, 0}, {3, 1, 5}, {0, 2, 4}, {0, 1, 2}, {3, 1, 4}, {5, 2, 1}, {0, 1, 5}, {3, 2, 3}};
+
+    for (int i = 0; i < 6; i++)
+        terms[i] = urdflib_create_uriref(i * 20);
+
+    // total order: by type, then bytewise
+    TEST_ASSERT_TRUE(urdflib_cmp(&terms[1], &terms[2]) < 0);
+    TEST_ASSERT_TRUE(urdflib_cmp(&terms[2], &terms[1]) > 0);
+    TEST_ASSERT_TRUE(urdflib_cmp(&terms[1], &literal) * urdflib_cmp(&literal, &terms[1]) < 0);
+
+    // same triples (and a duplicate) added in different orders
+    for (int i = 0; i < 8; i++)
+        urdflib_add_triple(&g, &terms[order[i][0]], &terms[order[i][1]], &terms[order[i][2]]);
+    for (int i = 7; i >= 0; i--)
+        urdflib_add_triple(&h, &terms[order[i][0]], &terms[order[i][1]], &terms[order[i][2]]);
+    urdflib_add_triple(&h, &terms[0], &terms[1], &terms[2]);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_freeze_with(&g, URDFLIB_FREEZE_SORTED));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_freeze_with(&h, URDFLIB_FREEZE_SORTED | URDFLIB_FREEZE_DIRECTORY));
+    TEST_ASSERT_TRUE(g.size < h.size);
+    TEST_ASSERT_EQUAL_MEMORY(g.buffer, h.buffer, g.size);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_next_triple(&g, &ctx, &prev_s, &prev_p, &val));
+    count = 1;
+    while (urdflib_find_next_triple(&g, &ctx, &s, &p, &val) == STATUS_OK)
+    {
+        TEST_ASSERT_TRUE(urdflib_cmp(&prev_s, &s) < 0 || (urdflib_cmp(&prev_s, &s) == 0 && urdflib_cmp(&prev_p, &p) <= 0));
+        prev_s = s;
+        prev_p = p;
+        count++;
+    }
+    TEST_ASSERT_EQUAL(8, count);
+
+    // sorted graphs can still grow
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_triple(&h, &terms[3], &terms[1], &literal));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&h, &ctx, NULL, NULL, &literal, &s, &p, &val));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&s, &terms[3]));
+
+    urdflib_delete(&g);
+    urdflib_delete(&h);
+    urdflib_delete(&literal);
+    for (int i = 0; i < 6; i++)
+        urdflib_delete(&terms[i]);
+}
+
+void test_freeze_sorted_empty_values()
+{
+    // { @id: 8, 6: [ ], 7: [ 10, 11 ] }, { @id: 9, 6: [ ] }
+    uint8_t b[24] = {0xBF, 0x01, 0x9F, 0xBF, 0x00, 0x08, 0x06, 0x9F, 0xFF, 0x07, 0x9F, 0x0A, 0x0B, 0xFF, 0xFF,
+                     0xBF, 0x00, 0x09, 0x06, 0x9F, 0xFF, 0xFF, 0xFF, 0xFF};
+    uint8_t expected[14] = {0xBF, 0x01, 0x9F, 0xBF, 0x00, 0x08, 0x07, 0x9F, 0x0A, 0x0B, 0xFF, 0xFF, 0xFF, 0xFF};
+    urdflib_t g = urdflib_create_graph();
+    urdflib_t s1 = urdflib_create_uriref(8);
+    urdflib_t p1 = urdflib_create_uriref(6);
+    urdflib_t placeholder = urdflib_create_literal("long enough for the buffer to hold b");
+    urdflib_t s, p, o;
+    urdflib_ctx_t ctx = {0};
+    int count;
+
+    // empty arrays are valid input, not only left by removed triples
+    urdflib_add_triple(&g, &s1, &p1, &placeholder);
+    TEST_ASSERT_TRUE(g.capacity >= sizeof(b));
+    memcpy(g.buffer, b, sizeof(b));
+    g.size = sizeof(b);
+    g.last_node_idx = 15;
+
+    // pairs without values are dropped, as well as nodes left without pairs
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_freeze_with(&g, URDFLIB_FREEZE_SORTED));
+    TEST_ASSERT_EQUAL(sizeof(expected), g.size);
+    TEST_ASSERT_EQUAL_MEMORY(expected, g.buffer, g.size);
+
+    count = 0;
+    while (urdflib_find_next_triple(&g, &ctx, &s, &p, &o) == STATUS_OK)
+        count++;
+    TEST_ASSERT_EQUAL(2, count);
+
+    urdflib_delete(&g);
+    urdflib_delete(&s1);
+    urdflib_delete(&p1);
+    urdflib_delete(&placeholder);
+}
+
+void test_dataset()
+{
+    urdflib_t ds = urdflib_create_dataset();
+    urdflib_t observes = urdflib_create_uriref(12);
+    urdflib_t o = urdflib_create_literal("temperature");
+    urdflib_t anonymous = urdflib_create_graph();
+    urdflib_t name, subject, g, s, p, val, graph_name, removed, expected;
+    urdflib_ctx_t ctx = {0};
+    int count = 0;
+
+    // one named graph per device, each with a single observation
+    for (uint16_t i = 0; i < 200; i++)
+    {
+        name = urdflib_create_uriref_curie(2, i);
+        subject = urdflib_create_uriref_curie(1, i);
+        g = urdflib_create_named_graph(&name);
+        urdflib_add_triple(&g, &subject, &observes, &o);
+        TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_graph(&ds, &g));
+        TEST_ASSERT_EQUAL(STATUS_ARG_ERROR, urdflib_add_graph(&ds, &g));
+        urdflib_delete(&g);
+        urdflib_delete(&subject);
+        urdflib_delete(&name);
+    }
+
+    TEST_ASSERT_EQUAL(STATUS_ARG_ERROR, urdflib_add_graph(&ds, &anonymous));
+
+    while (urdflib_find_next_quad(&ds, &ctx, &s, &p, &val, &graph_name) == STATUS_OK)
+    {
+        name = urdflib_create_uriref_curie(2, count);
+        subject = urdflib_create_uriref_curie(1, count);
+        TEST_ASSERT_EQUAL(0, urdflib_cmp(&graph_name, &name));
+        TEST_ASSERT_EQUAL(0, urdflib_cmp(&s, &subject));
+        urdflib_delete(&subject);
+        urdflib_delete(&name);
+        count++;
+    }
+    TEST_ASSERT_EQUAL(200, count);
+
+    // through the graph name index, then the directory
+    for (uint8_t options = 0; options <= URDFLIB_FREEZE_DIRECTORY; options += URDFLIB_FREEZE_DIRECTORY)
+    {
+        if (options > 0)
+            TEST_ASSERT_EQUAL(STATUS_OK, urdflib_freeze_with(&ds, options));
+
+        name = urdflib_create_uriref_curie(2, 123);
+        subject = urdflib_create_uriref_curie(1, 123);
+        TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_graph(&ds, &name, &g));
+        memset(&ctx, 0, sizeof(urdflib_ctx_t));
+        TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&g, &ctx, NULL, NULL, NULL, &s, &p, &val));
+        TEST_ASSERT_EQUAL(0, urdflib_cmp(&s, &subject));
+        TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_triples(&g, &ctx, NULL, NULL, NULL, &s, &p, &val));
+        urdflib_delete(&subject);
+        urdflib_delete(&name);
+    }
+
+    name = urdflib_create_uriref_curie(2, 500);
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_graph(&ds, &name, &g));
+
+    // removed triples are not copied
+    removed = urdflib_create_named_graph(&name);
+    expected = urdflib_create_named_graph(&name);
+    subject = urdflib_create_uriref_curie(1, 500);
+    urdflib_add_triple(&removed, &subject, &observes, &o);
+    urdflib_add_triple(&removed, &subject, &observes, &observes);
+    urdflib_add_triple(&expected, &subject, &observes, &observes);
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_remove_triple(&removed, &subject, &observes, &o));
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_add_graph(&ds, &removed));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_graph(&ds, &name, &g));
+    TEST_ASSERT_EQUAL(expected.size, g.size);
+    TEST_ASSERT_EQUAL_MEMORY(expected.buffer, g.buffer, g.size);
+
+    urdflib_delete(&removed);
+    urdflib_delete(&expected);
+    urdflib_delete(&subject);
+    urdflib_delete(&name);
+    urdflib_delete(&anonymous);
+    urdflib_delete(&ds);
+}
+
+void test_parse_chunks()
+{
+    urdflib_t g = urdflib_create_named_graph(&RDF_TYPE);
+    urdflib_t s1 = urdflib_create_uriref_curie(1, 300);
+    urdflib_t s2 = urdflib_create_bnode();
+    urdflib_t observes = urdflib_create_uriref(12);
+    urdflib_t time = urdflib_create_uriref(1000);
+    urdflib_t o1 = urdflib_create_literal("temperature");
+    urdflib_t o2 = urdflib_create_literal("humidity");
+    urdflib_t o3 = urdflib_create_literal_date(1706719470);
+    urdflib_t o4 = urdflib_create_literal_float(3.14);
+    urdflib_t s, p, o, expected_s, expected_p, expected_o;
+    urdflib_ctx_t ctx;
+    urdflib_parser_t parser;
+    int status, count;
+
+    urdflib_add_triple(&g, &s1, &observes, &o1);
+    urdflib_add_triple(&g, &s1, &observes, &o2);
+    urdflib_add_triple(&g, &s1, &time, &o3);
+    urdflib_add_triple(&g, &s2, &observes, &o4);
+    urdflib_freeze_with(&g, URDFLIB_FREEZE_DIRECTORY);
+
+    for (size_t chunk_size = 1; chunk_size <= g.size; chunk_size += 3)
+    {
+        urdflib_parser_init(&parser);
+        memset(&ctx, 0, sizeof(urdflib_ctx_t));
+        count = 0;
+        status = STATUS_NEED_INPUT;
+
+        for (size_t i = 0; i < g.size && status == STATUS_NEED_INPUT; i += chunk_size)
+        {
+            urdflib_parser_feed(&parser, g.buffer + i, i + chunk_size < g.size ? chunk_size : g.size - i);
+
+            while ((status = urdflib_parser_next(&parser, &s, &p, &o)) == STATUS_OK)
+            {
+                TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_next_triple(&g, &ctx, &expected_s, &expected_p, &expected_o));
+                TEST_ASSERT_EQUAL(0, urdflib_cmp(&s, &expected_s));
+                TEST_ASSERT_EQUAL(0, urdflib_cmp(&p, &expected_p));
+                TEST_ASSERT_EQUAL(0, urdflib_cmp(&o, &expected_o));
+                count++;
+            }
+        }
+
+        TEST_ASSERT_EQUAL(STATUS_NO_ITEM, status);
+        TEST_ASSERT_EQUAL(4, count);
+    }
+
+    // truncated graph
+    urdflib_parser_init(&parser);
+    urdflib_parser_feed(&parser, g.buffer, 10);
+    TEST_ASSERT_EQUAL(STATUS_NEED_INPUT, urdflib_parser_next(&parser, &s, &p, &o));
+
+    urdflib_delete(&g);
+}
+
+/**
+ * Sink appending written bytes to a graph buffer (with no break at the end).
+ */
+int write_to_graph(void *state, const uint8_t *data, size_t size)
+{
+    urdflib_t *g = state;
+
+    memcpy(g->buffer + g->size, data, size);
+    g->size += size;
+
+    return STATUS_OK;
+}
+
+void test_write_stream()
+{
+    uint8_t b[16384];
+    urdflib_t actual = {.buffer = b, .size = 0, .type = TYPE_GRAPH};
+    urdflib_t expected = urdflib_create_named_graph(&RDF_TYPE);
+    urdflib_t observes = urdflib_create_uriref(12);
+    urdflib_t time = urdflib_create_uriref(1000);
+    urdflib_t o1 = urdflib_create_literal("temperature");
+    urdflib_t o2 = urdflib_create_literal("humidity");
+    urdflib_t o3 = urdflib_create_literal_date(1706719470);
+    urdflib_t subject;
+    urdflib_writer_t writer;
+
+    urdflib_writer_init(&writer, write_to_graph, &actual);
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_write_graph_start(&writer, &RDF_TYPE));
+
+    for (uint16_t i = 0; i < 300; i++)
+    {
+        subject = urdflib_create_uriref_curie(1, i);
+        urdflib_add_triple(&expected, &subject, &observes, &o1);
+        TEST_ASSERT_EQUAL(STATUS_OK, urdflib_write_triple(&writer, &subject, &observes, &o1));
+        if (i % 3 == 0)
+        {
+            urdflib_add_triple(&expected, &subject, &observes, &o2);
+            TEST_ASSERT_EQUAL(STATUS_OK, urdflib_write_triple(&writer, &subject, &observes, &o2));
+        }
+        urdflib_add_triple(&expected, &subject, &time, &o3);
+        TEST_ASSERT_EQUAL(STATUS_OK, urdflib_write_triple(&writer, &subject, &time, &o3));
+        urdflib_delete(&subject);
+    }
+
+    // staged bytes are flushed as the graph grows
+    TEST_ASSERT_TRUE(actual.size > 0);
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_write_graph_end(&writer));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &actual));
+
+    urdflib_delete(&expected);
+}
+
+void test_graph_merge()
+{
+    urdflib_t a = urdflib_create_graph();
+    urdflib_t b = urdflib_create_graph();
+    urdflib_t p1 = urdflib_create_uriref(12);
+    urdflib_t p2 = urdflib_create_uriref(13);
+    urdflib_t o[8], subjects[6], bnode_a, bnode_b, expected, out, s, p, val;
+    urdflib_bnode_gen_t gen;
+    urdflib_ctx_t ctx = {0};
+    int count = 0;
+
+    for (int i = 0; i < 8; i++)
+        o[i] = urdflib_create_literal_float(i);
+    for (int i = 0; i < 6; i++)
+        subjects[i] = urdflib_create_uriref(i);
+
+    // blank nodes of both graphs share identifier 0
+    urdflib_bnode_gen_init(&gen, 0);
+    bnode_a = urdflib_create_bnode_with(&gen);
+    urdflib_bnode_gen_init(&gen, 0);
+    bnode_b = urdflib_create_bnode_with(&gen);
+
+    urdflib_add_triple(&a, &subjects[1], &p1, &o[1]);
+    urdflib_add_triple(&a, &subjects[2], &p1, &o[2]);
+    urdflib_add_triple(&a, &bnode_a, &p1, &o[3]);
+    urdflib_add_triple(&a, &subjects[4], &p1, &bnode_a);
+
+    urdflib_add_triple(&b, &subjects[3], &p1, &o[6]);
+    urdflib_add_triple(&b, &subjects[2], &p1, &o[2]);
+    urdflib_add_triple(&b, &subjects[2], &p1, &o[4]);
+    urdflib_add_triple(&b, &subjects[2], &p2, &o[5]);
+    urdflib_add_triple(&b, &bnode_b, &p1, &o[7]);
+    urdflib_add_triple(&b, &subjects[4], &p1, &bnode_b);
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_freeze_with(&b, URDFLIB_FREEZE_DIRECTORY));
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_graph_merge(&a, &b, &out));
+
+    // duplicate (s2, p1, o2) is dropped
+    while (urdflib_find_next_triple(&out, &ctx, &s, &p, &val) == STATUS_OK)
+        count++;
+    TEST_ASSERT_EQUAL(9, count);
+
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&out, &ctx, &subjects[2], &p1, NULL, &s, &p, &val));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&val, &o[2]));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&out, &ctx, &subjects[2], &p1, NULL, &s, &p, &val));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&val, &o[4]));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_triples(&out, &ctx, &subjects[2], &p1, NULL, &s, &p, &val));
+
+    // blank nodes of a and b remain distinct, in subjects and objects alike
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&out, &ctx, &bnode_a, NULL, NULL, &s, &p, &val));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&val, &o[3]));
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_triples(&out, &ctx, &bnode_a, NULL, NULL, &s, &p, &val));
+
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&out, &ctx, NULL, NULL, &o[7], &s, &p, &val));
+    TEST_ASSERT_TRUE(urdflib_cmp(&s, &bnode_a) != 0);
+    bnode_b = s;
+
+    count = 0;
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    while (urdflib_find_triples(&out, &ctx, &subjects[4], &p1, NULL, &s, &p, &val) == STATUS_OK)
+        count += urdflib_cmp(&val, &bnode_a) == 0 || urdflib_cmp(&val, &bnode_b) == 0;
+    TEST_ASSERT_EQUAL(2, count);
+
+    urdflib_delete(&out);
+    urdflib_delete(&a);
+    urdflib_delete(&b);
+
+    // graphs sorted by subject are merged in order
+    a = urdflib_create_graph();
+    b = urdflib_create_graph();
+    urdflib_add_triple(&a, &subjects[1], &p1, &o[1]);
+    urdflib_add_triple(&a, &subjects[3], &p1, &o[3]);
+    urdflib_add_triple(&a, &subjects[5], &p1, &o[5]);
+    urdflib_add_triple(&b, &subjects[2], &p1, &o[2]);
+    urdflib_add_triple(&b, &subjects[3], &p2, &o[3]);
+    urdflib_add_triple(&b, &subjects[4], &p1, &o[4]);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_graph_merge(&a, &b, &out));
+
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    for (int i = 0; i < 6; i++)
+    {
+        int k = i < 3 ? i + 1 : i;
+
+        TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_next_triple(&out, &ctx, &s, &p, &val));
+        TEST_ASSERT_EQUAL(0, urdflib_cmp(&s, &subjects[k]));
+        TEST_ASSERT_EQUAL(0, urdflib_cmp(&p, i == 3 ? &p2 : &p1));
+        TEST_ASSERT_EQUAL(0, urdflib_cmp(&val, &o[k]));
+    }
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_find_next_triple(&out, &ctx, &s, &p, &val));
+
+    urdflib_delete(&out);
+    urdflib_delete(&a);
+    urdflib_delete(&b);
+
+    // pairs and nodes whose values were all removed are dropped
+    a = urdflib_create_graph();
+    b = urdflib_create_graph();
+    expected = urdflib_create_graph();
+    urdflib_add_triple(&a, &subjects[1], &p1, &o[1]);
+    urdflib_add_triple(&a, &subjects[1], &p1, &o[2]);
+    urdflib_add_triple(&a, &subjects[1], &p2, &o[3]);
+    urdflib_add_triple(&a, &subjects[2], &p1, &o[4]);
+    urdflib_add_triple(&a, &subjects[2], &p1, &o[5]);
+    urdflib_add_triple(&b, &subjects[1], &p1, &o[6]);
+    urdflib_add_triple(&b, &subjects[1], &p1, &o[7]);
+    urdflib_add_triple(&b, &subjects[2], &p1, &o[6]);
+    urdflib_add_triple(&b, &subjects[2], &p1, &o[7]);
+    urdflib_remove_triples(&a, NULL, &p1, NULL);
+    urdflib_remove_triples(&b, NULL, &p1, NULL);
+    urdflib_add_triple(&expected, &subjects[1], &p2, &o[3]);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_graph_merge(&a, &b, &out));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &out));
+    TEST_ASSERT_EQUAL(0, out.removed_size);
+
+    urdflib_delete(&out);
+    urdflib_delete(&b);
+
+    // blank node identifiers too large to be renamed
+    b = urdflib_create_graph();
+    urdflib_bnode_gen_init(&gen, UINT64_MAX);
+    bnode_b = urdflib_create_bnode_with(&gen);
+    urdflib_add_triple(&b, &bnode_b, &p1, &o[1]);
+    TEST_ASSERT_EQUAL(STATUS_ARG_ERROR, urdflib_graph_merge(&a, &b, &out));
+    TEST_ASSERT_EQUAL(STATUS_ARG_ERROR, urdflib_graph_merge(&b, &a, &out));
+
+    urdflib_delete(&a);
+    urdflib_delete(&b);
+    urdflib_delete(&expected);
+    urdflib_delete(&bnode_a);
+    urdflib_delete(&bnode_b);
+    for (int i = 0; i < 8; i++)
+        urdflib_delete(&o[i]);
+    for (int i = 0; i < 6; i++)
+        urdflib_delete(&subjects[i]);
+    urdflib_delete(&p1);
+    urdflib_delete(&p2);
+}
+
+void test_map_file()
+{
+    urdflib_t g = urdflib_create_graph();
+    urdflib_t observes = urdflib_create_uriref(12);
+    urdflib_t o = urdflib_create_literal("temperature");
+    urdflib_t subject, mapped, s, p, val;
+    urdflib_ctx_t ctx = {0};
+    int count = 0;
+
+    for (uint16_t i = 0; i < 100; i++)
+    {
+        subject = urdflib_create_uriref_curie(1, i);
+        urdflib_add_triple(&g, &subject, &observes, &o);
+        urdflib_delete(&subject);
+    }
+    urdflib_freeze_with(&g, URDFLIB_FREEZE_DIRECTORY);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_save_file(&g, "test_graph.cbor"));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_open_file("test_graph.cbor", TYPE_GRAPH, &mapped));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&g, &mapped));
+
+    while (urdflib_find_next_triple(&mapped, &ctx, &s, &p, &val) == STATUS_OK)
+        count++;
+    TEST_ASSERT_EQUAL(100, count);
+
+    subject = urdflib_create_uriref_curie(1, 42);
+    memset(&ctx, 0, sizeof(urdflib_ctx_t));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_find_triples(&mapped, &ctx, &subject, NULL, NULL, &s, &p, &val));
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&s, &subject));
+
+    // mapped graphs are read-only
+    TEST_ASSERT_EQUAL(STATUS_BUFFER_ERROR, urdflib_add_triple(&mapped, &subject, &observes, &o));
+    TEST_ASSERT_EQUAL(g.size, mapped.size);
+
+    urdflib_close_file(&mapped);
+    remove("test_graph.cbor");
+
+    TEST_ASSERT_EQUAL(STATUS_IO_ERROR, urdflib_open_file("test_graph.cbor", TYPE_GRAPH, &mapped));
+
+    urdflib_delete(&subject);
+    urdflib_delete(&g);
+}
+
+void test_dict()
+{
+    const char *vocab = "# test vocabulary\n"
+                        "http://www.w3.org/1999/02/22-rdf-syntax-ns#type 2\n"
+                        "\n"
+                        "<https://saref.etsi.org/core/Observation> 15\r\n"
+                        "  https://saref.etsi.org/core/madeBy   16  \n"
+                        "https://example.org/sensor1 7:42";
+    const char *invalid[] = {"a 1\nb 2\na 3\n", "a 1\nb 1\n", "a 99999999999\n", "a\n"};
+    urdflib_dict_t dict;
+    urdflib_t term, expected;
+    const char *iri;
+    size_t len;
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_dict_parse(&dict, vocab, strlen(vocab)));
+    TEST_ASSERT_EQUAL(4, dict.size);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_dict_find_term(&dict, "https://saref.etsi.org/core/madeBy", 34, &term));
+    expected = urdflib_create_uriref(16);
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &term));
+    urdflib_delete(&expected);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_dict_find_term(&dict, "https://example.org/sensor1", 27, &term));
+    expected = urdflib_create_uriref_curie(7, 42);
+    TEST_ASSERT_EQUAL(0, urdflib_cmp(&expected, &term));
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_dict_find_iri(&dict, &expected, &iri, &len));
+    TEST_ASSERT_EQUAL(27, len);
+    TEST_ASSERT_EQUAL_MEMORY("https://example.org/sensor1", iri, len);
+    urdflib_delete(&expected);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_dict_find_iri(&dict, &RDF_TYPE, &iri, &len));
+    TEST_ASSERT_EQUAL_MEMORY("http://www.w3.org/1999/02/22-rdf-syntax-ns#type", iri, len);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_dict_find_term(&dict, "https://saref.etsi.org/core/Observation", 39, &term));
+    TEST_ASSERT_EQUAL(STATUS_OK, urdflib_dict_find_iri(&dict, &term, &iri, &len));
+    TEST_ASSERT_EQUAL(39, len);
+
+    // unknown IRIs and terms
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_dict_find_term(&dict, "https://saref.etsi.org/core/made", 32, &term));
+    expected = urdflib_create_uriref(17);
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_dict_find_iri(&dict, &expected, &iri, &len));
+    urdflib_delete(&expected);
+
+    urdflib_dict_delete(&dict);
+    TEST_ASSERT_EQUAL(0, dict.size);
+    TEST_ASSERT_EQUAL(STATUS_NO_ITEM, urdflib_dict_find_term(&dict, "https://example.org/sensor1", 27, &term));
+
+    // duplicates and malformed lines are rejected
+    for (int i = 0; i < 4; i++)
+        TEST_ASSERT_EQUAL(STATUS_ARG_ERROR, urdflib_dict_parse(&dict, invalid[i], strlen(invalid[i])));
+}
+
+#ifdef URDFLIB_STATS
+void test_stats()
+{
+    urdflib_t g = urdflib_create_graph();
+    urdflib_t observes = urdflib_create_uriref(12);
+    urdflib_t o = urdflib_create_literal("temperature");
+    urdflib_t subject, s, p, val;
+    urdflib_ctx_t ctx = {0};
+    urdflib_stats_t stats;
+    uint64_t calls;
+
+    for (uint16_t i = 0; i < 10; i++)
+    {
+        subject = urdflib_create_uriref_curie(1, i);
+        urdflib_add_triple(&g, &subject, &observes, &o);
+        urdflib_delete(&subject);
+    }
+
+    urdflib_stats_reset();
+    while (urdflib_find_next_triple(&g, &ctx, &s, &p, &val) == STATUS_OK)
+        ;
+
+    urdflib_stats_get(&stats);
+    TEST_ASSERT_EQUAL(11, stats.find_next_triple_calls);
+    TEST_ASSERT_EQUAL(0, stats.add_triple_calls);
+    TEST_ASSERT_TRUE(stats.tokens_decoded > 10);
+    TEST_ASSERT_EQUAL(0, stats.allocations);
+
+    calls = 0;
+    for (int i = 0; i < URDFLIB_STATS_BUCKETS; i++)
+        calls += stats.find_next_triple_latency[i];
+    TEST_ASSERT_EQUAL(11, calls);
+
+    // a new subject is appended: only the two final breaks are moved
+    urdflib_stats_reset();
+    subject = urdflib_create_uriref_curie(1, 10);
+    urdflib_add_triple(&g, &subject, &observes, &o);
+    urdflib_stats_get(&stats);
+    TEST_ASSERT_EQUAL(1, stats.add_triple_calls);
+    TEST_ASSERT_EQUAL(3 + subject.size + observes.size + o.size, stats.bytes_encoded);
+    TEST_ASSERT_EQUAL(2, stats.bytes_moved);
+
+    urdflib_delete(&subject);
+    urdflib_delete(&g);
+}
+#endif
+
 int main()
 {
     UNITY_BEGIN();
 
     RUN_TEST(test_create_uriref);
     RUN_TEST(test_create_uriref_curie);
+    RUN_TEST(test_create_wide_ids);
 
     RUN_TEST(test_create_bnode);
+    RUN_TEST(test_create_bnode_with);
 
     RUN_TEST(test_create_literal);
     RUN_TEST(test_create_literal_float);
     RUN_TEST(test_create_literal_date);
     RUN_TEST(test_create_typed_literal);
+    RUN_TEST(test_create_long_literal);
+    RUN_TEST(test_init_terms);
 
     RUN_TEST(test_create_graph);
     RUN_TEST(test_create_named_graph);
@@ -296,9 +1731,33 @@ int main()
     RUN_TEST(test_add_triples);
     RUN_TEST(test_add_literals);
     RUN_TEST(test_add_tree);
+    RUN_TEST(test_add_multiple_values);
+    RUN_TEST(test_add_unique_triples);
+    RUN_TEST(test_remove_triples);
+    RUN_TEST(test_add_interleaved_triples);
+    RUN_TEST(test_add_many_triples);
+    RUN_TEST(test_add_triples_bulk);
+    RUN_TEST(test_arena_graph);
 
     RUN_TEST(test_find_next_triple);
     RUN_TEST(test_find_in_tree);
+    RUN_TEST(test_find_wide_tokens);
+    RUN_TEST(test_find_mappings);
+    RUN_TEST(test_find_triples);
+    RUN_TEST(test_tape);
+    RUN_TEST(test_freeze_directory);
+    RUN_TEST(test_scan_parallel);
+    RUN_TEST(test_freeze_sorted);
+    RUN_TEST(test_freeze_sorted_empty_values);
+    RUN_TEST(test_dataset);
+    RUN_TEST(test_parse_chunks);
+    RUN_TEST(test_write_stream);
+    RUN_TEST(test_graph_merge);
+    RUN_TEST(test_map_file);
+    RUN_TEST(test_dict);
+#ifdef URDFLIB_STATS
+    RUN_TEST(test_stats);
+#endif
 
     return UNITY_END();
 }
@@ -0,0 +1,38 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <urdflib.h>
+
+/**
+ * Usage: urdflib_dictgen vocabulary.txt output.c name
+ *
+ * Compile a vocabulary (lines "IRI id" or "IRI namespace_id:id")
+ * into a constant urdflib_dict_t named name, to be linked with the application.
+ */
+int main(int argc, char const *argv[])
+{
+    urdflib_dict_t dict;
+    int status;
+
+    if (argc != 4)
+    {
+        fprintf(stderr, "Usage: %s vocabulary.txt output.c name\n", argv[0]);
+        return 1;
+    }
+
+    status = urdflib_dict_load(&dict, argv[1]);
+    if (status < STATUS_OK)
+    {
+        fprintf(stderr, "Vocabulary '%s' cannot be read (%d). Aborting.\n", argv[1], status);
+        return 1;
+    }
+
+    status = urdflib_dict_write_c(&dict, argv[2], argv[3]);
+    if (status < STATUS_OK)
+        fprintf(stderr, "File '%s' cannot be written. Aborting.\n", argv[2]);
+    else
+        printf("%zu terms written to '%s'.\n", dict.size, argv[2]);
+
+    urdflib_dict_delete(&dict);
+
+    return status < STATUS_OK;
+}